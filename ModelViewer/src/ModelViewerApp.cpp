@@ -7,7 +7,7 @@
 #include "engine/scene/Camera.h"
 #include "engine/scene/Scene.h"
 #include "engine/Primitives.h"
-#include "engine/ObjectParser.h"
+#include "engine/MeshCache.h"
 #include "engine/TextureParser.h"
 #include "engine/DiffuseMap.h"
 #include "engine/NormalMap.h"
@@ -20,8 +20,7 @@ namespace ModelViewer
     ModelViewerApp::ModelViewerApp(int width, int height)
         :
         m_RotateVector({0, 0, 0}),
-        m_rasterizer(width, height),
-        m_pool(std::thread::hardware_concurrency(), 0x8000)
+        m_renderer(width, height)
     {
         m_Scene = std::make_shared<Engine::Scene::Scene>();
 
@@ -56,83 +55,16 @@ namespace ModelViewer
 
     void ModelViewerApp::draw(Gdiplus::Graphics& gfx, const AdditionalDrawData& data)
     {
-        auto&& [verRef, verticesWorldRef, uvsRef, indRef, diffuseMap, normalMap, specularMap] = m_Scene->render(*m_Viewport);
-        const auto& vertices = verRef.get();
-        const auto& verticesWorld = verticesWorldRef.get();
-        const auto& uvs = uvsRef.get();
-        const auto& indices = indRef.get();
-
-        const auto drawLine = [this, &data](std::reference_wrapper<const std::vector<Vector4<double>>> ver, std::size_t aInd, std::size_t bInd)
-        {
-            const auto& [screenWidth, screenHeight] = data.dimensions;
-            std::optional clippedLine = Engine::Primitives::clipLine(0, 0, 
-                screenWidth, screenHeight, std::pair{ ver.get()[aInd], ver.get()[bInd] });
-
-            if (clippedLine)
-            {
-                const auto v1 = std::move((*clippedLine).first);
-                const auto v2 = std::move((*clippedLine).second);
-
-                m_rasterizer.drawLine(v1[X], v1[Y], v2[X], v2[Y], { 0xFF, 0xFF, 0xFF });
-            }
-        };
-
-        const auto drawTriangle = [this, &data](std::reference_wrapper<const std::vector<Vec4<double>>> ver,
-            std::reference_wrapper<const std::vector<Vec4<double>>> verticesWorld,
-            std::reference_wrapper<const std::vector<Vec3<double>>> uvs,
-            std::reference_wrapper<const std::vector<Engine::Index>> indices, std::size_t indexSelector,
-            std::reference_wrapper<const Vec3<int>> cameraVector,
-            std::reference_wrapper<const Engine::DiffuseMap> diffuseMap,
-            std::reference_wrapper<const Engine::NormalMap> normalMap,
-            std::reference_wrapper<const Engine::SpecularMap> specularMap)
-        {
-            Engine::Index aInd = indices.get()[indexSelector];
-            Engine::Index bInd = indices.get()[indexSelector + 1];
-            Engine::Index cInd = indices.get()[indexSelector + 2];
-
-            Engine::Primitives::FltTriangleRef triangle = {
-                std::cref(ver.get()[aInd.vertex]),
-                std::cref(ver.get()[bInd.vertex]),
-                std::cref(ver.get()[cInd.vertex])
-            };
-
-            if (Engine::Primitives::isTriangleTowardsCamera(cameraVector.get(), triangle))
-            {
-                m_rasterizer.drawTriangle(ver.get()[aInd.vertex], ver.get()[aInd.vertex][Z], verticesWorld.get()[aInd.vertex], uvs.get()[aInd.texture],
-                    ver.get()[bInd.vertex], ver.get()[bInd.vertex][Z], verticesWorld.get()[bInd.vertex], uvs.get()[bInd.texture],
-                    ver.get()[cInd.vertex], ver.get()[cInd.vertex][Z], verticesWorld.get()[cInd.vertex], uvs.get()[cInd.texture],
-                    diffuseMap.get(), normalMap.get(), specularMap.get());
-            }
-        };
-
-        const auto cameraVector = static_cast<Vector3<int>>(m_Camera->getPosition() - m_Camera->getTarget());
-
-        m_rasterizer.begin();
-
-        for (size_t i = 0; i < indices.size(); i += 3)
-        {
-            std::size_t aInd = indices[i].vertex;
-            std::size_t bInd = indices[i + 1].vertex;
-            std::size_t cInd = indices[i + 2].vertex;
-
-            if (vertices[aInd][Z] <= 0 || vertices[bInd][Z] <= 0 || vertices[cInd][Z] <= 0)
-                continue;
-
-#if 0
-            m_pool.enque(drawLine, std::cref(ver), aInd, bInd);
-            m_pool.enque(drawLine, std::cref(ver), bInd, cInd);
-            m_pool.enque(drawLine, std::cref(ver), cInd, aInd);
-#elif 1
-            //drawTriangle(verRef, verticesWorld, normalsRef, uvsRef, indRef, i, std::cref(cameraVector), color);
-            m_pool.enque(drawTriangle, verRef, verticesWorld, uvsRef, indRef, i, std::cref(cameraVector), 
-                std::cref(diffuseMap), std::cref(normalMap), std::cref(specularMap));
-
-#endif
-        }
-
-        m_pool.wait();
-
-        m_rasterizer.end(gfx);
+        m_renderer.render(*m_Scene, *m_Viewport);
+
+        const Engine::FrameBuffer& frameBuffer = m_renderer.getFrameBuffer();
+        const int width = frameBuffer.getWidth();
+        const int height = frameBuffer.getHeight();
+
+        // GDI+ only reads the pixels while drawing
+        Gdiplus::Bitmap bitmap(width, height, width * Engine::FrameBuffer::STRIDE, PixelFormat32bppRGB,
+            reinterpret_cast<BYTE*>(const_cast<unsigned*>(frameBuffer.getColorData())));
+        gfx.DrawImage(&bitmap, 0, 0, width, height);
     }
 
     void ModelViewerApp::rotateModelByX(double x)
@@ -178,11 +110,7 @@ namespace ModelViewer
 
     void ModelViewerApp::loadMeshFromFile(const std::wstring& filename, OnLoadCallback cb)
     {
-        Engine::ObjectParser parser(filename);
-
-        auto object = parser.parse();
-        m_Model = std::make_shared<Engine::Scene::Object>(std::move(object.vertices), std::move(object.normals),
-            std::move(object.textureVertices), std::move(object.indices));
+        m_Model = std::make_shared<Engine::Scene::Object>(Engine::loadMesh(filename, &m_renderer.getThreadPool()));
 
         if (cb)
             cb(true);
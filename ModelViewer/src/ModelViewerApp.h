@@ -1,13 +1,12 @@
 #pragma once
 #include "pch.h"
-#include "ThreadPool.h"
 #include "engine/ObjectParser.h"
 #include "math/Geometry.h"
 #include "math/Vector.h"
 #include "engine/scene/Scene.h"
 #include "engine/scene/Object.h"
 #include "engine/scene/Camera.h"
-#include "engine/Rasterizer.h"
+#include "engine/Renderer.h"
 #include "engine/light/Lambert.h"
 
 namespace ModelViewer
@@ -49,8 +48,6 @@ namespace ModelViewer
         std::shared_ptr<Engine::Scene::Scene> m_Scene = nullptr;
         std::shared_ptr<Engine::Viewport> m_Viewport = nullptr;
         std::shared_ptr<Engine::Scene::Camera> m_Camera = nullptr;
-        Engine::Rasterizer m_rasterizer;
-        std::mutex m_drawnLinesMutex;
-        ThreadPool m_pool;
+        Engine::Renderer m_renderer;
     };
 }
\ No newline at end of file
@@ -1,78 +1,349 @@
 #pragma once
 #include "pch.h"
+#include "Core.h"
 
+// Work-stealing thread pool. Every worker owns a Chase-Lev deque: the owner pushes and pops
+// at the bottom, idle workers steal from the top. The thread that created the pool takes part
+// in the work while it waits, so it owns a deque as well (index 0).
+//
+// Tasks live in per-thread preallocated storage and are never heap allocated. Storage is
+// recycled once the pool runs out of work, so parallelFor must be called either from the thread
+// that created the pool or from inside of the tasks. wait is only for the thread that created the pool:
+// a task waiting for all tasks would wait for itself. Both throw std::logic_error on other threads,
+// these checks stay in release builds since a foreign thread would race the owner of a deque.
+//
+// Idle workers spin for a while and then sleep until a task is pushed.
 class ThreadPool
 {
 public:
+    static constexpr std::size_t TASK_STORAGE_SIZE = 112;
+
+    // How many times an idle worker looks for work before it goes to sleep
+    static constexpr int SPIN_COUNT = 64;
+
+private:
+    struct alignas(64) Task
+    {
+        void (*invoke)(void* storage);
+        alignas(std::max_align_t) unsigned char storage[TASK_STORAGE_SIZE];
+    };
+
+    // Two cache lines, neighbouring tasks written by different threads don't share a line
+    static_assert(sizeof(Task) == 128);
+
+    // Chase-Lev deque of fixed capacity, see "Correct and Efficient Work-Stealing for Weak Memory Models"
+    class Deque
+    {
+    public:
+        explicit Deque(std::size_t capacity)
+            :
+            m_slots(capacity),
+            m_mask(static_cast<std::int64_t>(capacity) - 1)
+        {
+            expect((capacity & (capacity - 1)) == 0);
+        }
+
+        bool push(Task* task)
+        {
+            const std::int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+            const std::int64_t top = m_top.load(std::memory_order_acquire);
+
+            if (bottom - top > m_mask)
+                return false;
+
+            m_slots[bottom & m_mask].store(task, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        Task* pop()
+        {
+            const std::int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t top = m_top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Task* task = m_slots[bottom & m_mask].load(std::memory_order_relaxed);
+
+            // Last task: race against thieves
+            if (top == bottom)
+            {
+                if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    task = nullptr;
+
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+
+            return task;
+        }
+
+        Task* steal()
+        {
+            std::int64_t top = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+            if (top >= bottom)
+                return nullptr;
+
+            Task* task = m_slots[top & m_mask].load(std::memory_order_relaxed);
+
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+
+            return task;
+        }
+
+    private:
+        alignas(64) std::atomic<std::int64_t> m_top = 0;
+        alignas(64) std::atomic<std::int64_t> m_bottom = 0;
+        std::vector<std::atomic<Task*>> m_slots;
+        std::int64_t m_mask;
+    };
+
+    struct Worker
+    {
+        explicit Worker(std::size_t capacity)
+            :
+            deque(capacity),
+            tasks(capacity)
+        {
+        }
+
+        Deque deque;
+        std::vector<Task> tasks;
+
+        // Set by the constructor before any task exists, only read afterwards
+        std::thread::id thread;
+
+        // Written by the owner of the worker, reset by the thread that created the pool when there is no work
+        std::atomic<std::size_t> usedTasks = 0;
+    };
+
+public:
+    // tasksCount is how many tasks every thread can have queued at once. When a thread runs out of
+    // task storage, parallelFor stops splitting its range and runs the rest of it on that thread.
     ThreadPool(int threadsCount, int tasksCount = 0)
     {
-        m_threads.reserve(threadsCount);
-        m_tasks.reserve(tasksCount ? tasksCount : threadsCount);
+        const std::size_t capacity = roundUpToPowerOfTwo((std::max)(tasksCount, 1024));
+
+        m_workers.reserve(static_cast<std::size_t>(threadsCount) + 1);
+        for (int i = 0; i <= threadsCount; i++)
+            m_workers.push_back(std::make_unique<Worker>(capacity));
 
-        for (int i = 0; i < threadsCount; i++)
+        m_workers[0]->thread = std::this_thread::get_id();
+
+        m_threads.reserve(threadsCount);
+        for (int i = 1; i <= threadsCount; i++)
         {
-            m_threads.emplace_back(&task, this);
-            m_threads.back().detach();
+            m_threads.emplace_back(&task, this, static_cast<std::size_t>(i));
+            m_workers[i]->thread = m_threads.back().get_id();
         }
     }
 
     ~ThreadPool()
     {
-        m_shouldWork = false;
+        wait();
+
+        {
+            std::unique_lock l(m_mutex);
+            m_shouldWork = false;
+        }
         m_cv.notify_all();
 
-        wait();
+        for (auto& thread : m_threads)
+            thread.join();
     }
 
-    template<typename TCallable, typename ...TArgs>
-    void enque(TCallable task, TArgs ...args)
+    // Calls function(first, last) for subranges of [begin, end) not longer than grain and returns
+    // when all of them are done. The range is split in halves lazily, idle workers steal the halves.
+    template<typename TFunction>
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, const TFunction& function)
     {
-        auto&& binded = std::bind(task, std::forward<TArgs>(args)...);
+        if (begin >= end)
+            return;
+
+        const std::size_t self = currentWorker();
+        std::atomic<std::size_t> remaining = end - begin;
+        runRange(self, begin, end, (std::max)(grain, std::size_t(1)), &function, &remaining);
 
-        std::unique_lock l(m_mutex);
-        m_tasks.emplace_back(std::move(binded));
-        m_cv.notify_one();
+        while (remaining.load(std::memory_order_acquire) != 0)
+            if (!runOneTask(self))
+                std::this_thread::yield();
+
+        releaseTasksIfIdle(self);
     }
 
     void wait()
     {
-        std::unique_lock l(m_mutex);
+        if (std::this_thread::get_id() != m_workers[0]->thread)
+            throw std::logic_error("ThreadPool::wait is called from a thread other than the one that created the pool");
+
+        while (m_pendingTasks.load(std::memory_order_acquire) != 0)
+            if (!runOneTask(0))
+                std::this_thread::yield();
 
-        while (!m_tasks.empty())
-            m_otherCv.wait(l);
+        releaseTasksIfIdle(0);
     }
 
 private:
-    static void task(ThreadPool* t)
+    // Index of the worker the calling thread owns
+    std::size_t currentWorker() const
+    {
+        const std::thread::id thread = std::this_thread::get_id();
+
+        for (std::size_t i = 0; i < m_workers.size(); i++)
+            if (m_workers[i]->thread == thread)
+                return i;
+
+        throw std::logic_error("ThreadPool is used from a thread outside of the pool");
+    }
+
+    template<typename TFunction>
+    void runRange(std::size_t self, std::size_t begin, std::size_t end, std::size_t grain, const TFunction* function, std::atomic<std::size_t>* remaining)
+    {
+        Worker& worker = *m_workers[self];
+
+        // Out of task storage the rest of the range runs here, in order, one grain at a time
+        while (end - begin > grain && worker.usedTasks.load(std::memory_order_relaxed) < worker.tasks.size())
+        {
+            const std::size_t middle = begin + (end - begin) / 2;
+            push(self, [this, middle, end, grain, function, remaining]() { runRange(currentWorker(), middle, end, grain, function, remaining); });
+            end = middle;
+        }
+
+        for (std::size_t first = begin; first < end; first += grain)
+        {
+            const std::size_t last = (std::min)(first + grain, end);
+            (*function)(first, last);
+            remaining->fetch_sub(last - first, std::memory_order_acq_rel);
+        }
+    }
+
+    template<typename TClosure>
+    void push(std::size_t self, TClosure&& closure)
+    {
+        using Closure = std::decay_t<TClosure>;
+        static_assert(sizeof(Closure) <= TASK_STORAGE_SIZE, "Task arguments don't fit into the task storage");
+        static_assert(alignof(Closure) <= alignof(std::max_align_t), "Task arguments are overaligned");
+        static_assert(std::is_trivially_destructible_v<Closure>, "Task storage is reused without calling destructors");
+
+        Worker& worker = *m_workers[self];
+
+        // The caller checks for free storage. The deque is as long as the storage and every
+        // task is pushed once before the storage is recycled, so it can't be full either.
+        // Running out of either is a broken pool that a task has nowhere to report from.
+        const std::size_t used = worker.usedTasks.load(std::memory_order_relaxed);
+        if (used >= worker.tasks.size())
+            std::terminate();
+
+        Task& task = worker.tasks[used];
+        new (task.storage) Closure(std::forward<TClosure>(closure));
+        task.invoke = [](void* storage) { (*static_cast<Closure*>(storage))(); };
+
+        // Counted before it is published, so a thief can't finish it and drop the counter below zero
+        m_pendingTasks.fetch_add(1, std::memory_order_acq_rel);
+
+        if (!worker.deque.push(&task))
+            std::terminate();
+
+        worker.usedTasks.store(used + 1, std::memory_order_relaxed);
+
+        // Bumped after the task is visible: a worker that saw the old value before looking for work won't sleep.
+        // Both sides are sequentially consistent, so either the worker sees the new value or we see the sleeper.
+        m_pushes.fetch_add(1, std::memory_order_seq_cst);
+
+        if (m_sleepingWorkers.load(std::memory_order_seq_cst) != 0)
+        {
+            // The sleeper checks m_pushes under the lock, taking it prevents a lost wakeup
+            std::unique_lock l(m_mutex);
+            m_cv.notify_all();
+        }
+    }
+
+    // Runs a task from the own deque or stolen from another worker
+    bool runOneTask(std::size_t self)
+    {
+        Task* task = m_workers[self]->deque.pop();
+
+        for (std::size_t i = 1; !task && i < m_workers.size(); i++)
+            task = m_workers[(self + i) % m_workers.size()]->deque.steal();
+
+        if (!task)
+            return false;
+
+        task->invoke(task->storage);
+        m_pendingTasks.fetch_sub(1, std::memory_order_acq_rel);
+
+        return true;
+    }
+
+    void releaseTasksIfIdle(std::size_t self)
+    {
+        // Only the creating thread outside of any task may recycle task storage
+        if (self != 0 || m_pendingTasks.load(std::memory_order_acquire) != 0)
+            return;
+
+        for (auto& worker : m_workers)
+            worker->usedTasks.store(0, std::memory_order_relaxed);
+    }
+
+    static void task(ThreadPool* t, std::size_t index)
     {
-        while (t->m_shouldWork)
+        int spins = 0;
+
+        while (true)
         {
-            std::function<void()> tsk;
+            const std::size_t pushes = t->m_pushes.load(std::memory_order_seq_cst);
+
+            if (t->runOneTask(index))
             {
-                std::unique_lock l(t->m_mutex);
-                while (t->m_tasks.empty() && t->m_shouldWork)
-                {
-                    t->m_otherCv.notify_all();
-                    t->m_cv.wait(l);
-                }
-
-                if (!t->m_shouldWork)
-                    return;
-
-                tsk = std::move(t->m_tasks.back());
-                t->m_tasks.pop_back();
+                spins = 0;
+                continue;
             }
 
+            // Running tasks may spawn new ones soon, don't sleep right away
+            if (++spins < SPIN_COUNT)
+            {
+                std::this_thread::yield();
+                continue;
+            }
 
-            tsk();
+            spins = 0;
+
+            std::unique_lock l(t->m_mutex);
+            t->m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+            t->m_cv.wait(l, [t, pushes]() { return t->m_pushes.load(std::memory_order_seq_cst) != pushes || !t->m_shouldWork; });
+            t->m_sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+
+            if (!t->m_shouldWork)
+                return;
         }
     }
 
+    static std::size_t roundUpToPowerOfTwo(int value)
+    {
+        std::size_t result = 1;
+        while (result < static_cast<std::size_t>(value))
+            result <<= 1;
+
+        return result;
+    }
+
 private:
-    std::vector<std::function<void(void)>> m_tasks;
+    std::vector<std::unique_ptr<Worker>> m_workers;
     std::vector<std::thread> m_threads;
+    std::atomic<std::size_t> m_pendingTasks = 0;
+    std::atomic<std::size_t> m_pushes = 0;
+    std::atomic<int> m_sleepingWorkers = 0;
     std::condition_variable m_cv;
-    std::condition_variable m_otherCv;
     std::mutex m_mutex;
-    volatile bool m_shouldWork = true;
-};
\ No newline at end of file
+    bool m_shouldWork = true;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include "pch.h"
+#include "Core.h"
+
+namespace ModelViewer::Engine
+{
+    // Read only view of contiguous elements owned by someone else
+    template<typename T>
+    class ArrayView
+    {
+    public:
+        ArrayView() = default;
+
+        ArrayView(const T* data, std::size_t size)
+            :
+            m_data(data),
+            m_size(size)
+        {
+        }
+
+        ArrayView(const std::vector<T>& vector)
+            :
+            m_data(vector.data()),
+            m_size(vector.size())
+        {
+        }
+
+        inline const T& operator[](std::size_t i) const
+        {
+            expect(i < m_size);
+            return m_data[i];
+        }
+
+        inline const T* data() const
+        {
+            return m_data;
+        }
+
+        inline std::size_t size() const
+        {
+            return m_size;
+        }
+
+        inline bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        inline const T* begin() const
+        {
+            return m_data;
+        }
+
+        inline const T* end() const
+        {
+            return m_data + m_size;
+        }
+
+    private:
+        const T* m_data = nullptr;
+        std::size_t m_size = 0;
+    };
+}
@@ -0,0 +1,211 @@
+#include "pch.h"
+#include "Bvh.h"
+
+namespace ModelViewer::Engine
+{
+    namespace
+    {
+        constexpr int SAH_BINS = 16;
+        // Deeper than this the tree is split at the median, so the depth stays within MAX_DEPTH
+        constexpr int SAH_MAX_DEPTH = 32;
+        // Testing a node box costs about as much as testing an item box
+        constexpr double TRAVERSAL_COST = 1;
+        constexpr double REBUILD_COST_RATIO = 2;
+    }
+
+    void Bvh::build(ArrayView<BoundingBox> bounds)
+    {
+        m_nodes.clear();
+        m_items.resize(bounds.size());
+        std::iota(m_items.begin(), m_items.end(), 0);
+
+        if (bounds.empty())
+        {
+            m_builtCost = 0;
+            return;
+        }
+
+        std::vector<Vec3<double>> centers(bounds.size());
+        for (std::size_t i = 0; i < bounds.size(); i++)
+            centers[i] = bounds[i].isEmpty() ? Vec3<double>({ 0.0, 0.0, 0.0 }) : (bounds[i].min + bounds[i].max) * 0.5;
+
+        m_nodes.reserve(2 * bounds.size());
+        buildNode(bounds, centers, 0, static_cast<std::uint32_t>(bounds.size()), 0);
+
+        m_builtCost = computeCost();
+    }
+
+    void Bvh::refit(ArrayView<BoundingBox> bounds)
+    {
+        expect(bounds.size() == m_items.size());
+
+        // Children are stored after their parents
+        for (std::size_t i = m_nodes.size(); i-- > 0;)
+        {
+            Node& node = m_nodes[i];
+            node.bounds = BoundingBox::empty();
+
+            if (node.secondChild == 0)
+            {
+                for (std::uint32_t item = node.firstItem; item < node.firstItem + node.itemsCount; item++)
+                    node.bounds.extend(bounds[m_items[item]]);
+            }
+            else
+            {
+                node.bounds.extend(m_nodes[i + 1].bounds);
+                node.bounds.extend(m_nodes[node.secondChild].bounds);
+            }
+        }
+
+        if (computeCost() > REBUILD_COST_RATIO * m_builtCost)
+            build(bounds);
+    }
+
+    bool Bvh::empty() const
+    {
+        return m_nodes.empty();
+    }
+
+    const std::vector<Bvh::Node>& Bvh::getNodes() const
+    {
+        return m_nodes;
+    }
+
+    const std::vector<std::uint32_t>& Bvh::getItems() const
+    {
+        return m_items;
+    }
+
+    std::uint32_t Bvh::buildNode(ArrayView<BoundingBox> bounds, const std::vector<Vec3<double>>& centers,
+        std::uint32_t begin, std::uint32_t end, int depth)
+    {
+        const std::uint32_t nodeIndex = static_cast<std::uint32_t>(m_nodes.size());
+        const std::uint32_t count = end - begin;
+
+        BoundingBox nodeBounds = BoundingBox::empty();
+        BoundingBox centerBounds = BoundingBox::empty();
+
+        for (std::uint32_t i = begin; i < end; i++)
+        {
+            nodeBounds.extend(bounds[m_items[i]]);
+            centerBounds.extend(centers[m_items[i]]);
+        }
+
+        m_nodes.push_back({ nodeBounds, begin, count, 0 });
+
+        if (count == 1)
+            return nodeIndex;
+
+        int axis = 0;
+        for (int i = 1; i < 3; i++)
+            if (centerBounds.max[i] - centerBounds.min[i] > centerBounds.max[axis] - centerBounds.min[axis])
+                axis = i;
+
+        const double axisMin = centerBounds.min[axis];
+        const double axisExtent = centerBounds.max[axis] - axisMin;
+        const auto firstItem = m_items.begin() + begin;
+        const auto lastItem = m_items.begin() + end;
+
+        std::uint32_t middle = begin + count / 2;
+
+        if (axisExtent <= 0)
+        {
+            // Every center is at the same point, any split is as good as another
+            if (count <= MAX_LEAF_ITEMS)
+                return nodeIndex;
+        }
+        else if (depth >= SAH_MAX_DEPTH)
+        {
+            std::nth_element(firstItem, m_items.begin() + middle, lastItem,
+                [&](std::uint32_t a, std::uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+        }
+        else
+        {
+            struct Bin
+            {
+                BoundingBox bounds = BoundingBox::empty();
+                std::uint32_t count = 0;
+            };
+
+            const auto binOf = [&](std::uint32_t item)
+            {
+                return (std::min)(static_cast<int>((centers[item][axis] - axisMin) * (SAH_BINS / axisExtent)), SAH_BINS - 1);
+            };
+
+            Bin bins[SAH_BINS];
+            for (auto item = firstItem; item != lastItem; ++item)
+            {
+                Bin& bin = bins[binOf(*item)];
+                bin.bounds.extend(bounds[*item]);
+                bin.count++;
+            }
+
+            // Cost of the right side of the split after every bin, swept from the right
+            double rightCosts[SAH_BINS];
+            Bin right;
+            for (int i = SAH_BINS - 1; i > 0; i--)
+            {
+                right.bounds.extend(bins[i].bounds);
+                right.count += bins[i].count;
+                rightCosts[i - 1] = right.bounds.getSurfaceArea() * right.count;
+            }
+
+            int bestSplit = -1;
+            double bestCost = std::numeric_limits<double>::infinity();
+            Bin left;
+
+            for (int i = 0; i < SAH_BINS - 1; i++)
+            {
+                left.bounds.extend(bins[i].bounds);
+                left.count += bins[i].count;
+
+                if (left.count == 0 || left.count == count)
+                    continue;
+
+                const double cost = left.bounds.getSurfaceArea() * left.count + rightCosts[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestSplit = i;
+                }
+            }
+
+            // Costs are relative to the area of the node
+            const double area = nodeBounds.getSurfaceArea();
+            const double leafCost = area * count;
+            const double splitCost = area * TRAVERSAL_COST + bestCost;
+
+            if (count <= MAX_LEAF_ITEMS && leafCost <= splitCost)
+                return nodeIndex;
+
+            // The first and the last bins are never empty, so there is always a split
+            expect(bestSplit >= 0);
+
+            middle = static_cast<std::uint32_t>(std::partition(firstItem, lastItem,
+                [&](std::uint32_t item) { return binOf(item) <= bestSplit; }) - m_items.begin());
+        }
+
+        buildNode(bounds, centers, begin, middle, depth + 1);
+        const std::uint32_t secondChild = buildNode(bounds, centers, middle, end, depth + 1);
+
+        m_nodes[nodeIndex].secondChild = secondChild;
+
+        return nodeIndex;
+    }
+
+    double Bvh::computeCost() const
+    {
+        if (m_nodes.empty())
+            return 0;
+
+        const double rootArea = m_nodes[0].bounds.getSurfaceArea();
+        if (rootArea <= 0)
+            return 0;
+
+        double cost = 0;
+        for (const Node& node : m_nodes)
+            cost += node.bounds.getSurfaceArea() * (node.secondChild == 0 ? node.itemsCount : TRAVERSAL_COST);
+
+        return cost / rootArea;
+    }
+}
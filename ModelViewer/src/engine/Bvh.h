@@ -0,0 +1,154 @@
+#pragma once
+#include "pch.h"
+#include "engine/ArrayView.h"
+#include "engine/MeshCluster.h"
+#include "engine/Frustum.h"
+#include "engine/Ray.h"
+
+namespace ModelViewer::Engine
+{
+    // Bounding volume hierarchy over boxes of items given by their index. Built with the surface
+    // area heuristic and stored depth first in one array: the first child follows its parent, so
+    // traversal mostly goes forward through memory. Items of every subtree are consecutive.
+    class Bvh
+    {
+    public:
+        static constexpr std::uint32_t MAX_LEAF_ITEMS = 8;
+        static constexpr int MAX_DEPTH = 64;
+
+        // One cache line per node
+        struct alignas(64) Node
+        {
+            BoundingBox bounds;
+            std::uint32_t firstItem;
+            std::uint32_t itemsCount;
+            // 0 for leaves, the root is never a second child
+            std::uint32_t secondChild;
+        };
+
+    public:
+        void build(ArrayView<BoundingBox> bounds);
+        // Updates boxes of the nodes after items moved, keeping the tree. Rebuilds it when the moves
+        // made it twice as expensive to traverse as the built one.
+        void refit(ArrayView<BoundingBox> bounds);
+        bool empty() const;
+        const std::vector<Node>& getNodes() const;
+        // Item indices in the order of the leaves
+        const std::vector<std::uint32_t>& getItems() const;
+
+        // Calls visitor(item, containment) for items of nodes that are not outside of the frustum.
+        // Items of leaves crossing the frustum planes are reported as INTERSECTS and may still be outside.
+        template<typename TVisitor>
+        void query(const Frustum& frustum, const TVisitor& visitor) const
+        {
+            if (m_nodes.empty())
+                return;
+
+            std::uint32_t stack[MAX_DEPTH + 1];
+            int stackSize = 0;
+            stack[stackSize++] = 0;
+
+            while (stackSize > 0)
+            {
+                const std::uint32_t nodeIndex = stack[--stackSize];
+                const Node& node = m_nodes[nodeIndex];
+                const Frustum::Containment containment = frustum.test(node.bounds);
+
+                if (containment == Frustum::Containment::OUTSIDE)
+                    continue;
+
+                if (containment == Frustum::Containment::INSIDE || node.secondChild == 0)
+                {
+                    for (std::uint32_t i = node.firstItem; i < node.firstItem + node.itemsCount; i++)
+                        visitor(m_items[i], containment);
+
+                    continue;
+                }
+
+                stack[stackSize++] = node.secondChild;
+                stack[stackSize++] = nodeIndex + 1;
+            }
+        }
+
+        // Calls visitor(item, culled) for every item. Items of nodes whose boxes isCulled(bounds) rejects are
+        // reported as culled without testing the nodes below, the rest as not culled.
+        template<typename TTest, typename TVisitor>
+        void cull(const TTest& isCulled, const TVisitor& visitor) const
+        {
+            if (m_nodes.empty())
+                return;
+
+            std::uint32_t stack[MAX_DEPTH + 1];
+            int stackSize = 0;
+            stack[stackSize++] = 0;
+
+            while (stackSize > 0)
+            {
+                const std::uint32_t nodeIndex = stack[--stackSize];
+                const Node& node = m_nodes[nodeIndex];
+                const bool culled = isCulled(node.bounds);
+
+                if (culled || node.secondChild == 0)
+                {
+                    for (std::uint32_t i = node.firstItem; i < node.firstItem + node.itemsCount; i++)
+                        visitor(m_items[i], culled);
+
+                    continue;
+                }
+
+                stack[stackSize++] = node.secondChild;
+                stack[stackSize++] = nodeIndex + 1;
+            }
+        }
+
+        // Closest hit: calls visitor(item, closest) for items whose boxes the ray hits closer than
+        // the closest hit so far, the visitor returns the new closest distance. Returns the closest
+        // distance, maxDistance when nothing was hit.
+        template<typename TVisitor>
+        double intersect(const Ray& ray, double maxDistance, const TVisitor& visitor) const
+        {
+            if (m_nodes.empty())
+                return maxDistance;
+
+            const Vec3<double> inverseDirection({ 1 / ray.direction[0], 1 / ray.direction[1], 1 / ray.direction[2] });
+            double closest = maxDistance;
+
+            std::uint32_t stack[MAX_DEPTH + 1];
+            int stackSize = 0;
+            stack[stackSize++] = 0;
+
+            while (stackSize > 0)
+            {
+                const std::uint32_t nodeIndex = stack[--stackSize];
+                const Node& node = m_nodes[nodeIndex];
+
+                if (!ray.intersects(node.bounds, inverseDirection, closest))
+                    continue;
+
+                if (node.secondChild == 0)
+                {
+                    for (std::uint32_t i = node.firstItem; i < node.firstItem + node.itemsCount; i++)
+                        closest = (std::min)(closest, visitor(m_items[i], closest));
+
+                    continue;
+                }
+
+                stack[stackSize++] = node.secondChild;
+                stack[stackSize++] = nodeIndex + 1;
+            }
+
+            return closest;
+        }
+
+    private:
+        std::uint32_t buildNode(ArrayView<BoundingBox> bounds, const std::vector<Vec3<double>>& centers,
+            std::uint32_t begin, std::uint32_t end, int depth);
+        // Expected cost of a random ray or frustum query relative to testing the root box
+        double computeCost() const;
+
+    private:
+        std::vector<Node> m_nodes;
+        std::vector<std::uint32_t> m_items;
+        double m_builtCost = 0;
+    };
+}
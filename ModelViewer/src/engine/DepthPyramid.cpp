@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "DepthPyramid.h"
+#include "Core.h"
+
+namespace ModelViewer::Engine
+{
+    namespace
+    {
+        float roundUp(double depth)
+        {
+            if (depth >= (std::numeric_limits<float>::max)())
+                return std::numeric_limits<float>::infinity();
+
+            const float rounded = static_cast<float>(depth);
+            return rounded < depth ? std::nextafter(rounded, std::numeric_limits<float>::infinity()) : rounded;
+        }
+    }
+
+    DepthPyramid::DepthPyramid(int width, int height)
+        :
+        m_width(width),
+        m_height(height)
+    {
+        int levelWidth = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        int levelHeight = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        while (true)
+        {
+            m_levels.push_back({ levelWidth, levelHeight,
+                std::vector<float>(static_cast<std::size_t>(levelWidth) * levelHeight, std::numeric_limits<float>::infinity()) });
+
+            if (levelWidth == 1 && levelHeight == 1)
+                break;
+
+            levelWidth = (levelWidth + 1) / 2;
+            levelHeight = (levelHeight + 1) / 2;
+        }
+    }
+
+    void DepthPyramid::updateTile(const FrameBuffer& frameBuffer, const Tile& tile)
+    {
+        static_assert(TileBinner::TILE_SIZE % BLOCK_SIZE == 0);
+
+        Level& level = m_levels[0];
+
+        frameBuffer.visitDepth([&](const auto* depth)
+        {
+            using Encoding = DepthEncoding<std::decay_t<decltype(*depth)>>;
+
+            for (int blockY = tile.top; blockY < tile.bottom; blockY += BLOCK_SIZE)
+            {
+                for (int blockX = tile.left; blockX < tile.right; blockX += BLOCK_SIZE)
+                {
+                    const int lastX = (std::min)(blockX + BLOCK_SIZE, tile.right);
+                    const int lastY = (std::min)(blockY + BLOCK_SIZE, tile.bottom);
+                    auto farthest = depth[static_cast<std::size_t>(blockY) * m_width + blockX];
+
+                    // Compared as stored, only the farthest one is decoded
+                    for (int y = blockY; y < lastY; y++)
+                    {
+                        const auto* row = depth + static_cast<std::size_t>(y) * m_width;
+
+                        for (int x = blockX; x < lastX; x++)
+                            if (Encoding::isInFront(farthest, row[x]))
+                                farthest = row[x];
+                    }
+
+                    level.depths[static_cast<std::size_t>(blockY / BLOCK_SIZE) * level.width + blockX / BLOCK_SIZE] =
+                        roundUp(Encoding::decode(farthest));
+                }
+            }
+        });
+    }
+
+    void DepthPyramid::clearTile(const Tile& tile)
+    {
+        Level& level = m_levels[0];
+
+        for (int blockY = tile.top; blockY < tile.bottom; blockY += BLOCK_SIZE)
+            for (int blockX = tile.left; blockX < tile.right; blockX += BLOCK_SIZE)
+                level.depths[static_cast<std::size_t>(blockY / BLOCK_SIZE) * level.width + blockX / BLOCK_SIZE] = std::numeric_limits<float>::infinity();
+    }
+
+    void DepthPyramid::buildLevels()
+    {
+        for (std::size_t i = 1; i < m_levels.size(); i++)
+        {
+            const Level& source = m_levels[i - 1];
+            Level& level = m_levels[i];
+
+            for (int y = 0; y < level.height; y++)
+            {
+                // Odd sizes: the last texel covers only one source row or column
+                const int sourceTop = 2 * y;
+                const int sourceBottom = (std::min)(sourceTop + 1, source.height - 1);
+
+                for (int x = 0; x < level.width; x++)
+                {
+                    const int sourceLeft = 2 * x;
+                    const int sourceRight = (std::min)(sourceLeft + 1, source.width - 1);
+
+                    level.depths[static_cast<std::size_t>(y) * level.width + x] = (std::max)({
+                        source.depths[static_cast<std::size_t>(sourceTop) * source.width + sourceLeft],
+                        source.depths[static_cast<std::size_t>(sourceTop) * source.width + sourceRight],
+                        source.depths[static_cast<std::size_t>(sourceBottom) * source.width + sourceLeft],
+                        source.depths[static_cast<std::size_t>(sourceBottom) * source.width + sourceRight]
+                    });
+                }
+            }
+        }
+    }
+
+    bool DepthPyramid::isOccluded(double minX, double minY, double maxX, double maxY, double minZ) const
+    {
+        // Pixels the rasterizers may touch, rectangles are clipped to the screen
+        const int left = static_cast<int>(std::floor((std::max)(minX, 0.0)));
+        const int top = static_cast<int>(std::floor((std::max)(minY, 0.0)));
+        const int right = static_cast<int>(std::floor((std::min)(maxX, m_width - 1.0)));
+        const int bottom = static_cast<int>(std::floor((std::min)(maxY, m_height - 1.0)));
+
+        // Nothing on the screen
+        if (left > right || top > bottom)
+            return true;
+
+        int firstX = left / BLOCK_SIZE;
+        int firstY = top / BLOCK_SIZE;
+        int lastX = right / BLOCK_SIZE;
+        int lastY = bottom / BLOCK_SIZE;
+
+        // The finest level where the rectangle covers at most 2x2 texels
+        std::size_t levelIndex = 0;
+        while (lastX - firstX > 1 || lastY - firstY > 1)
+        {
+            firstX >>= 1;
+            firstY >>= 1;
+            lastX >>= 1;
+            lastY >>= 1;
+            levelIndex++;
+        }
+
+        expect(levelIndex < m_levels.size());
+        const Level& level = m_levels[levelIndex];
+
+        float farthest = 0;
+        for (int y = firstY; y <= lastY; y++)
+            for (int x = firstX; x <= lastX; x++)
+                farthest = (std::max)(farthest, level.depths[static_cast<std::size_t>(y) * level.width + x]);
+
+        return minZ > farthest;
+    }
+}
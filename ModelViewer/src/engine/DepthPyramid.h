@@ -0,0 +1,39 @@
+#pragma once
+#include "pch.h"
+#include "engine/TileBinner.h"
+#include "engine/FrameBuffer.h"
+
+namespace ModelViewer::Engine
+{
+    // Hierarchical Z: the farthest depth of 8x8 pixel blocks of the depth buffer in level 0,
+    // every texel of the next level covers 2x2 texels of the previous one. Depths are rounded
+    // up to floats, so everything reported as occluded fails the depth test for sure.
+    class DepthPyramid
+    {
+    public:
+        static constexpr int BLOCK_SIZE = 8;
+
+    public:
+        DepthPyramid(int width, int height);
+        // Level 0 for the blocks of a tile, tiles are updated in parallel
+        void updateTile(const FrameBuffer& frameBuffer, const Tile& tile);
+        // Level 0 for a tile nothing was drawn into
+        void clearTile(const Tile& tile);
+        // Coarser levels from level 0, after every tile is updated
+        void buildLevels();
+        // Whether every fragment in the pixel rectangle with depth of minZ or farther is hidden
+        bool isOccluded(double minX, double minY, double maxX, double maxY, double minZ) const;
+
+    private:
+        struct Level
+        {
+            int width;
+            int height;
+            std::vector<float> depths;
+        };
+
+        std::vector<Level> m_levels;
+        int m_width;
+        int m_height;
+    };
+}
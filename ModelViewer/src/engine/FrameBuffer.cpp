@@ -0,0 +1,142 @@
+#include "pch.h"
+#include "FrameBuffer.h"
+#include "Core.h"
+
+namespace ModelViewer::Engine
+{
+    FrameBuffer::FrameBuffer(int width, int height)
+        :
+        m_width(width),
+        m_height(height),
+        m_colors(static_cast<std::size_t>(width) * height),
+        m_depths(static_cast<std::size_t>(width) * height)
+    {
+    }
+
+    void FrameBuffer::clear()
+    {
+        std::memset(m_colors.data(), 0, m_colors.size() * sizeof(unsigned));
+
+        // Cleared reversed depth is all zero bits
+        if (m_depthFormat == DepthFormat::FLOAT64)
+            std::fill(m_depths.begin(), m_depths.end(), DepthEncoding<double>::CLEARED);
+        else
+            std::memset(m_reversedDepths.data(), 0, m_reversedDepths.size() * sizeof(float));
+    }
+
+    void FrameBuffer::clear(int left, int top, int right, int bottom)
+    {
+        expect(left >= 0 && top >= 0 && right <= m_width && bottom <= m_height);
+
+        const std::size_t count = static_cast<std::size_t>((std::max)(right - left, 0));
+
+        visitDepth([&](auto* depth)
+        {
+            using Depth = std::decay_t<decltype(*depth)>;
+
+            for (int y = top; y < bottom; y++)
+            {
+                const std::size_t offset = static_cast<std::size_t>(y) * m_width + left;
+                std::memset(m_colors.data() + offset, 0, count * sizeof(unsigned));
+                std::fill(depth + offset, depth + offset + count, DepthEncoding<Depth>::CLEARED);
+            }
+        });
+    }
+
+    void FrameBuffer::setDepthFormat(DepthFormat format)
+    {
+        if (format == m_depthFormat)
+            return;
+
+        const std::size_t count = static_cast<std::size_t>(m_width) * m_height;
+        m_depthFormat = format;
+
+        if (format == DepthFormat::FLOAT64)
+        {
+            m_depths.resize(count);
+            std::vector<float>().swap(m_reversedDepths);
+        }
+        else
+        {
+            m_reversedDepths.resize(count);
+            std::vector<double>().swap(m_depths);
+        }
+    }
+
+    DepthFormat FrameBuffer::getDepthFormat() const
+    {
+        return m_depthFormat;
+    }
+
+    int FrameBuffer::getWidth() const
+    {
+        return m_width;
+    }
+
+    int FrameBuffer::getHeight() const
+    {
+        return m_height;
+    }
+
+    unsigned* FrameBuffer::getColorData()
+    {
+        return m_colors.data();
+    }
+
+    const unsigned* FrameBuffer::getColorData() const
+    {
+        return m_colors.data();
+    }
+
+    void* FrameBuffer::getDepthData()
+    {
+        return visitDepth([](auto* depth) -> void* { return depth; });
+    }
+
+    const void* FrameBuffer::getDepthData() const
+    {
+        return visitDepth([](const auto* depth) -> const void* { return depth; });
+    }
+
+    Color FrameBuffer::getPixel(int x, int y) const
+    {
+        expect(x >= 0 && x < m_width && y >= 0 && y < m_height);
+
+        const unsigned pixel = m_colors[static_cast<std::size_t>(y) * m_width + x];
+
+        return {
+            static_cast<ColorChannel>(pixel >> 16),
+            static_cast<ColorChannel>(pixel >> 8),
+            static_cast<ColorChannel>(pixel)
+        };
+    }
+
+    std::vector<ColorChannel> FrameBuffer::readRGB() const
+    {
+        std::vector<ColorChannel> out(m_colors.size() * 3);
+
+        for (std::size_t i = 0; i < m_colors.size(); i++)
+        {
+            out[3 * i] = static_cast<ColorChannel>(m_colors[i] >> 16);
+            out[3 * i + 1] = static_cast<ColorChannel>(m_colors[i] >> 8);
+            out[3 * i + 2] = static_cast<ColorChannel>(m_colors[i]);
+        }
+
+        return out;
+    }
+
+    std::vector<ColorChannel> FrameBuffer::readRGBA() const
+    {
+        std::vector<ColorChannel> out(m_colors.size() * 4);
+
+        for (std::size_t i = 0; i < m_colors.size(); i++)
+        {
+            out[4 * i] = static_cast<ColorChannel>(m_colors[i] >> 16);
+            out[4 * i + 1] = static_cast<ColorChannel>(m_colors[i] >> 8);
+            out[4 * i + 2] = static_cast<ColorChannel>(m_colors[i]);
+            out[4 * i + 3] = Color::MAX;
+        }
+
+        return out;
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "pch.h"
+#include "engine/Color.h"
+
+namespace ModelViewer::Engine
+{
+    // FLOAT64 stores depth z as is. FLOAT32_REVERSED stores 1 / z, so nearer is greater and the
+    // cleared value is 0: float precision is spread evenly over distances and depth traffic halves.
+    enum class DepthFormat
+    {
+        FLOAT64,
+        FLOAT32_REVERSED
+    };
+
+    // Depth as stored in a depth buffer of T, the format is given by the type
+    template<typename T>
+    struct DepthEncoding;
+
+    template<>
+    struct DepthEncoding<double>
+    {
+        static constexpr double CLEARED = (std::numeric_limits<double>::max)();
+
+        static double encode(double z)
+        {
+            return z;
+        }
+
+        static double decode(double depth)
+        {
+            return depth;
+        }
+
+        static bool isInFront(double depth, double stored)
+        {
+            return depth < stored;
+        }
+
+        static bool isSurface(double stored)
+        {
+            return stored > 0 && stored < CLEARED;
+        }
+    };
+
+    template<>
+    struct DepthEncoding<float>
+    {
+        static constexpr float CLEARED = 0;
+
+        static float encode(double z)
+        {
+            return static_cast<float>(1 / z);
+        }
+
+        static double decode(float depth)
+        {
+            return 1.0 / depth;
+        }
+
+        static bool isInFront(float depth, float stored)
+        {
+            return depth > stored;
+        }
+
+        static bool isSurface(float stored)
+        {
+            return stored > 0;
+        }
+    };
+
+    // Offscreen render target. Colors are stored as 0x00RRGGBB, rows go from top to bottom.
+    class FrameBuffer
+    {
+    public:
+        static constexpr int STRIDE = 4;
+
+    public:
+        FrameBuffer(int width, int height);
+        void clear();
+        // Clears the pixels from (left, top) up to but not including (right, bottom)
+        void clear(int left, int top, int right, int bottom);
+        // Reallocates the depth buffer, its contents are undefined until the next clear
+        void setDepthFormat(DepthFormat format);
+        DepthFormat getDepthFormat() const;
+        int getWidth() const;
+        int getHeight() const;
+        unsigned* getColorData();
+        const unsigned* getColorData() const;
+        // Depth of the pixels in the depth format
+        void* getDepthData();
+        const void* getDepthData() const;
+        Color getPixel(int x, int y) const;
+
+        // Calls visitor with the depth data as double* or float* by the depth format
+        template<typename TVisitor>
+        decltype(auto) visitDepth(TVisitor&& visitor)
+        {
+            if (m_depthFormat == DepthFormat::FLOAT64)
+                return visitor(m_depths.data());
+
+            return visitor(m_reversedDepths.data());
+        }
+
+        template<typename TVisitor>
+        decltype(auto) visitDepth(TVisitor&& visitor) const
+        {
+            if (m_depthFormat == DepthFormat::FLOAT64)
+                return visitor(m_depths.data());
+
+            return visitor(m_reversedDepths.data());
+        }
+
+        // Tightly packed 8 bit per channel copies of the color buffer
+        std::vector<ColorChannel> readRGB() const;
+        std::vector<ColorChannel> readRGBA() const;
+
+    private:
+        int m_width;
+        int m_height;
+        std::vector<unsigned> m_colors;
+        DepthFormat m_depthFormat = DepthFormat::FLOAT64;
+        // Only the buffer of the depth format is allocated
+        std::vector<double> m_depths;
+        std::vector<float> m_reversedDepths;
+    };
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "pch.h"
+
+namespace ModelViewer::Engine
+{
+    using StageDuration = std::chrono::duration<double, std::milli>;
+
+    // Wall clock time of every stage of the last rendered frame. Rasterization and shading run
+    // interleaved on all workers, the time of the tile pass is split between them by the share
+    // of worker time spent in span kernels. They are only measured with profiling enabled.
+    // With deferred shading or the visibility buffer, shading is the pass that follows rasterization.
+    // Tiles are cleared as the tile pass first draws them, clear is the time of clearing the rest.
+    struct FrameStats
+    {
+        StageDuration transform;
+        StageDuration clear;
+        StageDuration culling;
+        StageDuration rasterization;
+        StageDuration shading;
+        StageDuration present;
+
+        std::size_t trianglesSubmitted;
+        // Triangles of clusters that passed frustum culling
+        std::size_t trianglesInFrustum;
+        // Triangles of clusters hidden behind the depth pyramid
+        std::size_t trianglesOccluded;
+        std::size_t trianglesRasterized;
+        // Pixels that passed the depth test of span kernels, overdraw included
+        std::size_t pixelsShaded;
+    };
+
+    // Span kernel work done by the calling thread since it started
+    struct ShadingCounters
+    {
+        std::chrono::steady_clock::duration time;
+        std::size_t pixels;
+    };
+}
@@ -0,0 +1,48 @@
+#include "pch.h"
+#include "Frustum.h"
+
+namespace ModelViewer::Engine
+{
+    Frustum::Frustum(const Matrix4<double>& toClipSpace)
+    {
+        // Rows of the matrix give clip coordinates, matrices are indexed as (column, row)
+        Vec4<double> rows[4];
+        for (int row = 0; row < 4; row++)
+            for (int column = 0; column < 4; column++)
+                rows[row][column] = toClipSpace(column, row);
+
+        // Left, right, bottom, top, near and far
+        m_planes[0] = rows[3] + rows[0];
+        m_planes[1] = rows[3] - rows[0];
+        m_planes[2] = rows[3] + rows[1];
+        m_planes[3] = rows[3] - rows[1];
+        m_planes[4] = rows[2];
+        m_planes[5] = rows[3] - rows[2];
+    }
+
+    Frustum::Containment Frustum::test(const BoundingBox& box) const
+    {
+        Containment result = Containment::INSIDE;
+
+        for (const Vec4<double>& plane : m_planes)
+        {
+            // Corners of the box farthest along the plane normal and against it
+            double farthest = plane[3];
+            double nearest = plane[3];
+
+            for (int i = 0; i < 3; i++)
+            {
+                farthest += plane[i] * (plane[i] >= 0 ? box.max[i] : box.min[i]);
+                nearest += plane[i] * (plane[i] >= 0 ? box.min[i] : box.max[i]);
+            }
+
+            if (farthest < 0)
+                return Containment::OUTSIDE;
+
+            if (nearest < 0)
+                result = Containment::INTERSECTS;
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "pch.h"
+#include "math/Matrix.h"
+#include "math/Vector.h"
+#include "engine/MeshCluster.h"
+
+namespace ModelViewer::Engine
+{
+    // View volume of a projection as planes in the space the matrix is applied to, so an object's
+    // projection * view * model matrix gives planes that boxes in object space are tested against
+    class Frustum
+    {
+    public:
+        enum class Containment
+        {
+            OUTSIDE,
+            INTERSECTS,
+            INSIDE
+        };
+
+    public:
+        // Clip space is -w <= x, y <= w and 0 <= z <= w, see Camera::getProjectionMatrix
+        Frustum(const Matrix4<double>& toClipSpace);
+        Containment test(const BoundingBox& box) const;
+
+    private:
+        static constexpr int PLANES_COUNT = 6;
+
+        // (a, b, c, d) with a * x + b * y + c * z + d >= 0 inside
+        Vec4<double> m_planes[PLANES_COUNT];
+    };
+}
@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ModelViewer::Engine
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::filesystem::path& filename, FileAccess access)
+    {
+        const DWORD flags = access == FileAccess::SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+        m_file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("could not open " + filename.string());
+
+        LARGE_INTEGER size = {};
+        if (!GetFileSizeEx(m_file, &size))
+        {
+            CloseHandle(m_file);
+            throw std::runtime_error("could not get size of " + filename.string());
+        }
+
+        m_size = static_cast<std::size_t>(size.QuadPart);
+
+        // Empty files can't be mapped
+        if (m_size == 0)
+            return;
+
+        m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        m_data = m_mapping ? static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+        if (!m_data)
+        {
+            if (m_mapping)
+                CloseHandle(m_mapping);
+            CloseHandle(m_file);
+            throw std::runtime_error("could not map " + filename.string());
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        CloseHandle(m_file);
+    }
+#else
+    MappedFile::MappedFile(const std::filesystem::path& filename, FileAccess access)
+    {
+        const int file = open(filename.c_str(), O_RDONLY);
+
+        if (file < 0)
+            throw std::runtime_error("could not open " + filename.string());
+
+        struct stat status = {};
+        if (fstat(file, &status) != 0)
+        {
+            close(file);
+            throw std::runtime_error("could not get size of " + filename.string());
+        }
+
+        m_size = static_cast<std::size_t>(status.st_size);
+
+        // Empty files can't be mapped
+        if (m_size == 0)
+        {
+            close(file);
+            return;
+        }
+
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+        // The mapping stays valid after the descriptor is closed
+        close(file);
+
+        if (data == MAP_FAILED)
+            throw std::runtime_error("could not map " + filename.string());
+
+        madvise(data, m_size, access == FileAccess::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_WILLNEED);
+        m_data = static_cast<const char*>(data);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_data)
+            munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+
+    const char* MappedFile::getData() const
+    {
+        return m_data;
+    }
+
+    std::size_t MappedFile::getSize() const
+    {
+        return m_size;
+    }
+}
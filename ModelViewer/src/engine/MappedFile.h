@@ -0,0 +1,34 @@
+#pragma once
+#include "pch.h"
+
+namespace ModelViewer::Engine
+{
+    // How the mapping is read, the operating system reads ahead and evicts pages by it
+    enum class FileAccess
+    {
+        // Read once from start to end
+        SEQUENTIAL,
+        // Kept and read at random, the whole file is read ahead
+        RANDOM
+    };
+
+    // Read only view of a whole file mapped into memory
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::filesystem::path& filename, FileAccess access = FileAccess::SEQUENTIAL);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+        const char* getData() const;
+        std::size_t getSize() const;
+
+    private:
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+#ifdef _WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+#endif
+    };
+}
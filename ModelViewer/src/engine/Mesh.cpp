@@ -0,0 +1,27 @@
+#include "pch.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+namespace ModelViewer::Engine
+{
+    Mesh Mesh::fromParsedObject(const ParsedObject& object)
+    {
+        WeldedMesh welded = MeshWelder(object).weld();
+
+        MeshOptimizer optimizer(welded);
+        optimizer.optimizeVertexCache();
+        optimizer.optimizeVertexFetch();
+        optimizer.buildClusters();
+
+        const auto storage = std::make_shared<const WeldedMesh>(std::move(welded));
+
+        return {
+            storage->vertices,
+            storage->normals,
+            storage->textureVertices,
+            storage->indices,
+            storage->clusters,
+            storage
+        };
+    }
+}
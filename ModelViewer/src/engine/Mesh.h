@@ -0,0 +1,23 @@
+#pragma once
+#include "pch.h"
+#include "math/Vector.h"
+#include "engine/ArrayView.h"
+#include "engine/ObjectParser.h"
+#include "engine/MeshWelder.h"
+
+namespace ModelViewer::Engine
+{
+    // Welded geometry of an object, see MeshWelder. The arrays live in storage shared between
+    // copies of the mesh: vectors of a welded object or a memory mapped mesh cache.
+    struct Mesh
+    {
+        ArrayView<Vec4<double>> vertices;
+        ArrayView<Vec3<double>> normals;
+        ArrayView<Vec3<double>> textureVertices;
+        ArrayView<VertexIndex> indices;
+        ArrayView<MeshCluster> clusters;
+        std::shared_ptr<const void> storage;
+
+        static Mesh fromParsedObject(const ParsedObject& object);
+    };
+}
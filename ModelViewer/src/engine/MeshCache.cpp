@@ -0,0 +1,283 @@
+#include "pch.h"
+#include "MeshCache.h"
+#include "engine/MappedFile.h"
+#include "engine/ObjectParser.h"
+
+namespace ModelViewer::Engine
+{
+    namespace
+    {
+        constexpr char MAGIC[8] = { 'M', 'V', 'M', 'E', 'S', 'H', 0, 0 };
+
+        // Order of arrays in the file
+        enum MeshArray
+        {
+            VERTICES,
+            NORMALS,
+            TEXTURE_VERTICES,
+            INDICES,
+            CLUSTERS,
+            ARRAYS_COUNT
+        };
+
+        struct ArrayHeader
+        {
+            std::uint64_t offset;
+            std::uint64_t count;
+            std::uint64_t elementSize;
+        };
+
+        struct Header
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t alignment;
+            std::uint64_t sourceSize;
+            std::int64_t sourceTime;
+            std::uint64_t sourceHash;
+            ArrayHeader arrays[ARRAYS_COUNT];
+        };
+
+        static_assert(std::is_trivially_copyable_v<Vec4<double>> && std::is_trivially_copyable_v<Vec3<double>>
+            && std::is_trivially_copyable_v<VertexIndex> && std::is_trivially_copyable_v<MeshCluster>, "Mesh arrays are written and mapped as raw bytes");
+
+        // Bytes hashed at the beginning and at the end of the source, hashing a whole multi gigabyte
+        // file would take longer than parsing it in parallel
+        constexpr std::size_t HASHED_BYTES = 1 << 16;
+
+        std::uint64_t fnv1a(const char* data, std::size_t size, std::uint64_t hash)
+        {
+            for (std::size_t i = 0; i < size; i++)
+            {
+                hash ^= static_cast<unsigned char>(data[i]);
+                hash *= 0x100000001B3ull;
+            }
+
+            return hash;
+        }
+
+        std::uint64_t alignOffset(std::uint64_t offset)
+        {
+            return (offset + MeshCache::ALIGNMENT - 1) / MeshCache::ALIGNMENT * MeshCache::ALIGNMENT;
+        }
+
+        template<typename T>
+        ArrayView<T> mapArray(const MappedFile& file, const ArrayHeader& array)
+        {
+            return { reinterpret_cast<const T*>(file.getData() + array.offset), static_cast<std::size_t>(array.count) };
+        }
+
+        template<typename T>
+        bool isArrayValid(const ArrayHeader& array, std::size_t fileSize)
+        {
+            return array.elementSize == sizeof(T)
+                && array.offset % MeshCache::ALIGNMENT == 0
+                && array.offset <= fileSize
+                && array.count <= (fileSize - array.offset) / sizeof(T);
+        }
+
+        // Arrays that fit the file may still hold garbage that matches the source key: every index and
+        // cluster has to stay inside of the arrays it refers to
+        bool isMeshValid(const Mesh& mesh)
+        {
+            const std::size_t verticesCount = mesh.vertices.size();
+
+            if (mesh.normals.size() != verticesCount || mesh.textureVertices.size() != verticesCount || mesh.indices.size() % 3 != 0)
+                return false;
+
+            VertexIndex maxIndex = 0;
+            for (const VertexIndex index : mesh.indices)
+                maxIndex = (std::max)(maxIndex, index);
+
+            if (!mesh.indices.empty() && maxIndex >= verticesCount)
+                return false;
+
+            const std::uint64_t trianglesCount = mesh.indices.size() / 3;
+
+            for (const MeshCluster& cluster : mesh.clusters)
+            {
+                if (std::uint64_t(cluster.firstTriangle) + cluster.trianglesCount > trianglesCount
+                    || std::uint64_t(cluster.firstVertex) + cluster.verticesCount > verticesCount)
+                    return false;
+            }
+
+            return true;
+        }
+    }
+
+    MeshCache::MeshCache(std::filesystem::path source)
+        :
+        m_source(std::move(source)),
+        m_path(m_source)
+    {
+        m_path += ".meshcache";
+    }
+
+    std::optional<Mesh> MeshCache::read() const
+    {
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(m_path, error))
+            return std::nullopt;
+
+        // Vertices and indices are fetched at random while rendering for as long as the mesh lives
+        std::shared_ptr<const MappedFile> file;
+
+        try
+        {
+            file = std::make_shared<const MappedFile>(m_path, FileAccess::RANDOM);
+        }
+        catch (const std::exception&)
+        {
+            // E.g. no permission to read it, the mesh is parsed from the source instead
+            return std::nullopt;
+        }
+
+        if (file->getSize() < sizeof(Header))
+            return std::nullopt;
+
+        Header header;
+        std::memcpy(&header, file->getData(), sizeof(Header));
+
+        const SourceKey key = readSourceKey();
+
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.alignment != ALIGNMENT
+            || header.sourceSize != key.size || header.sourceTime != key.time || header.sourceHash != key.hash)
+            return std::nullopt;
+
+        const std::size_t size = file->getSize();
+
+        if (!isArrayValid<Vec4<double>>(header.arrays[VERTICES], size)
+            || !isArrayValid<Vec3<double>>(header.arrays[NORMALS], size)
+            || !isArrayValid<Vec3<double>>(header.arrays[TEXTURE_VERTICES], size)
+            || !isArrayValid<VertexIndex>(header.arrays[INDICES], size)
+            || !isArrayValid<MeshCluster>(header.arrays[CLUSTERS], size))
+            return std::nullopt;
+
+        Mesh mesh = {
+            mapArray<Vec4<double>>(*file, header.arrays[VERTICES]),
+            mapArray<Vec3<double>>(*file, header.arrays[NORMALS]),
+            mapArray<Vec3<double>>(*file, header.arrays[TEXTURE_VERTICES]),
+            mapArray<VertexIndex>(*file, header.arrays[INDICES]),
+            mapArray<MeshCluster>(*file, header.arrays[CLUSTERS]),
+            file
+        };
+
+        if (!isMeshValid(mesh))
+            return std::nullopt;
+
+        return mesh;
+    }
+
+    void MeshCache::write(const Mesh& mesh) const
+    {
+        const SourceKey key = readSourceKey();
+
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.alignment = ALIGNMENT;
+        header.sourceSize = key.size;
+        header.sourceTime = key.time;
+        header.sourceHash = key.hash;
+
+        const std::pair<const char*, ArrayHeader> arrays[ARRAYS_COUNT] = {
+            { reinterpret_cast<const char*>(mesh.vertices.data()), { 0, mesh.vertices.size(), sizeof(Vec4<double>) } },
+            { reinterpret_cast<const char*>(mesh.normals.data()), { 0, mesh.normals.size(), sizeof(Vec3<double>) } },
+            { reinterpret_cast<const char*>(mesh.textureVertices.data()), { 0, mesh.textureVertices.size(), sizeof(Vec3<double>) } },
+            { reinterpret_cast<const char*>(mesh.indices.data()), { 0, mesh.indices.size(), sizeof(VertexIndex) } },
+            { reinterpret_cast<const char*>(mesh.clusters.data()), { 0, mesh.clusters.size(), sizeof(MeshCluster) } }
+        };
+
+        std::uint64_t offset = alignOffset(sizeof(Header));
+        for (int i = 0; i < ARRAYS_COUNT; i++)
+        {
+            header.arrays[i] = arrays[i].second;
+            header.arrays[i].offset = offset;
+            offset = alignOffset(offset + arrays[i].second.count * arrays[i].second.elementSize);
+        }
+
+        // Readers never see a partially written cache
+        std::filesystem::path temporary = m_path;
+        temporary += ".tmp";
+
+        try
+        {
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                const char padding[ALIGNMENT] = {};
+
+                out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+                std::uint64_t written = sizeof(Header);
+
+                for (int i = 0; i < ARRAYS_COUNT; i++)
+                {
+                    out.write(padding, static_cast<std::streamsize>(header.arrays[i].offset - written));
+                    out.write(arrays[i].first, static_cast<std::streamsize>(header.arrays[i].count * header.arrays[i].elementSize));
+                    written = header.arrays[i].offset + header.arrays[i].count * header.arrays[i].elementSize;
+                }
+
+                if (!out)
+                    throw std::runtime_error("could not write " + temporary.string());
+            }
+
+            std::filesystem::rename(temporary, m_path);
+        }
+        catch (const std::exception&)
+        {
+            // Nothing reads the temporary file, it would stay next to the model for good
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            throw;
+        }
+    }
+
+    const std::filesystem::path& MeshCache::getPath() const
+    {
+        return m_path;
+    }
+
+    MeshCache::SourceKey MeshCache::readSourceKey() const
+    {
+        SourceKey key = {};
+        key.size = std::filesystem::file_size(m_source);
+        key.time = static_cast<std::int64_t>(std::filesystem::last_write_time(m_source).time_since_epoch().count());
+
+        std::ifstream in(m_source, std::ios::binary);
+        std::vector<char> buffer(HASHED_BYTES);
+
+        key.hash = fnv1a(reinterpret_cast<const char*>(&key.size), sizeof(key.size), 0xCBF29CE484222325ull);
+
+        in.read(buffer.data(), static_cast<std::streamsize>((std::min)(key.size, std::uint64_t(HASHED_BYTES))));
+        key.hash = fnv1a(buffer.data(), static_cast<std::size_t>(in.gcount()), key.hash);
+
+        if (key.size > HASHED_BYTES)
+        {
+            in.seekg(-static_cast<std::streamoff>(HASHED_BYTES), std::ios::end);
+            in.read(buffer.data(), HASHED_BYTES);
+            key.hash = fnv1a(buffer.data(), static_cast<std::size_t>(in.gcount()), key.hash);
+        }
+
+        return key;
+    }
+
+    Mesh loadMesh(const std::filesystem::path& filename, ThreadPool* pool)
+    {
+        const MeshCache cache(filename);
+
+        if (std::optional<Mesh> mesh = cache.read())
+            return std::move(*mesh);
+
+        Mesh mesh = Mesh::fromParsedObject(ObjectParser(filename, pool).parse());
+
+        try
+        {
+            cache.write(mesh);
+        }
+        catch (const std::exception&)
+        {
+            // The cache only speeds up the next load, e.g. the directory may be read only
+        }
+
+        return mesh;
+    }
+}
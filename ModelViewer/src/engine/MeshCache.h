@@ -0,0 +1,41 @@
+#pragma once
+#include "pch.h"
+#include "engine/Mesh.h"
+
+class ThreadPool;
+
+namespace ModelViewer::Engine
+{
+    // Binary copy of a parsed mesh stored next to the source file as "<source>.meshcache".
+    // Arrays are laid out as in memory, so a valid cache is memory mapped and used without copying.
+    class MeshCache
+    {
+    public:
+        static constexpr std::uint32_t VERSION = 4;
+        static constexpr std::size_t ALIGNMENT = 64;
+
+    public:
+        MeshCache(std::filesystem::path source);
+        // Empty when there is no cache, it was built from another version of the source or it is damaged
+        std::optional<Mesh> read() const;
+        void write(const Mesh& mesh) const;
+        const std::filesystem::path& getPath() const;
+
+    private:
+        struct SourceKey
+        {
+            std::uint64_t size;
+            std::int64_t time;
+            std::uint64_t hash;
+        };
+
+        SourceKey readSourceKey() const;
+
+    private:
+        std::filesystem::path m_source;
+        std::filesystem::path m_path;
+    };
+
+    // Maps the cache of the file when it is up to date, otherwise parses the file and rebuilds the cache
+    Mesh loadMesh(const std::filesystem::path& filename, ThreadPool* pool = nullptr);
+}
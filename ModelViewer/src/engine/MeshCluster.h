@@ -0,0 +1,88 @@
+#pragma once
+#include "pch.h"
+#include "math/Vector.h"
+
+namespace ModelViewer::Engine
+{
+    // Axis aligned box, in object space unless stated otherwise
+    struct BoundingBox
+    {
+        Vec3<double> min;
+        Vec3<double> max;
+
+        static BoundingBox empty()
+        {
+            constexpr double MAX = (std::numeric_limits<double>::max)();
+            return { Vec3<double>({ MAX, MAX, MAX }), Vec3<double>({ -MAX, -MAX, -MAX }) };
+        }
+
+        void extend(const Vec3<double>& point)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                min[i] = (std::min)(min[i], point[i]);
+                max[i] = (std::max)(max[i], point[i]);
+            }
+        }
+
+        void extend(const BoundingBox& box)
+        {
+            if (box.isEmpty())
+                return;
+
+            extend(box.min);
+            extend(box.max);
+        }
+
+        bool isEmpty() const
+        {
+            return min[0] > max[0];
+        }
+
+        double getSurfaceArea() const
+        {
+            if (isEmpty())
+                return 0;
+
+            const Vec3<double> size = max - min;
+            return 2 * (size[0] * size[1] + size[1] * size[2] + size[2] * size[0]);
+        }
+
+        // Box around the transformed box, see Arvo "Transforming Axis-Aligned Bounding Boxes"
+        BoundingBox transform(const Matrix4<double>& matrix) const
+        {
+            if (isEmpty())
+                return *this;
+
+            BoundingBox out;
+
+            for (int row = 0; row < 3; row++)
+            {
+                out.min[row] = out.max[row] = matrix(3, row);
+
+                for (int column = 0; column < 3; column++)
+                {
+                    const double a = matrix(column, row) * min[column];
+                    const double b = matrix(column, row) * max[column];
+                    out.min[row] += (std::min)(a, b);
+                    out.max[row] += (std::max)(a, b);
+                }
+            }
+
+            return out;
+        }
+    };
+
+    // Consecutive triangles of a mesh that are culled together, see MeshOptimizer::buildClusters
+    struct MeshCluster
+    {
+        static constexpr std::uint32_t TRIANGLES = 256;
+
+        BoundingBox bounds;
+        std::uint32_t firstTriangle;
+        std::uint32_t trianglesCount;
+        // Range of vertices the triangles refer to
+        std::uint32_t firstVertex;
+        std::uint32_t verticesCount;
+    };
+}
@@ -0,0 +1,271 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+namespace ModelViewer::Engine
+{
+    namespace
+    {
+        constexpr float CACHE_DECAY_POWER = 1.5f;
+        constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+        constexpr float VALENCE_BOOST_SCALE = 2.0f;
+        constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+        // Scores of vertices with more remaining triangles are computed directly
+        constexpr std::uint32_t MAX_TABLE_VALENCE = 32;
+
+        // Triangles of a vertex checked for the next best one, bounds the work around vertices shared by many triangles
+        constexpr std::uint32_t MAX_CANDIDATES_PER_VERTEX = 64;
+
+        constexpr std::uint32_t NO_TRIANGLE = (std::numeric_limits<std::uint32_t>::max)();
+
+        class VertexScores
+        {
+        public:
+            VertexScores()
+            {
+                for (int i = 0; i < MeshOptimizer::CACHE_SIZE; i++)
+                {
+                    // The vertices of the last triangle get a fixed score, so it isn't reused right away
+                    m_cache[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                        : std::pow(1.0f - static_cast<float>(i - 3) / (MeshOptimizer::CACHE_SIZE - 3), CACHE_DECAY_POWER);
+                }
+
+                for (std::uint32_t i = 0; i < MAX_TABLE_VALENCE; i++)
+                    m_valence[i] = valenceScore(i);
+            }
+
+            float operator()(int cachePosition, std::uint32_t remainingTriangles) const
+            {
+                // Vertices without triangles to draw don't matter any more
+                if (remainingTriangles == 0)
+                    return -1.0f;
+
+                const float cacheScore = cachePosition < 0 ? 0.0f : m_cache[cachePosition];
+
+                return cacheScore + (remainingTriangles < MAX_TABLE_VALENCE ? m_valence[remainingTriangles] : valenceScore(remainingTriangles));
+            }
+
+        private:
+            // Vertices with few triangles left are finished first, that avoids leaving lonely triangles behind
+            static float valenceScore(std::uint32_t remainingTriangles)
+            {
+                return remainingTriangles == 0 ? 0.0f : VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+            }
+
+        private:
+            float m_cache[MeshOptimizer::CACHE_SIZE];
+            float m_valence[MAX_TABLE_VALENCE];
+        };
+    }
+
+    MeshOptimizer::MeshOptimizer(WeldedMesh& mesh)
+        :
+        m_mesh(mesh)
+    {
+    }
+
+    void MeshOptimizer::optimizeVertexCache()
+    {
+        const std::vector<VertexIndex>& indices = m_mesh.indices;
+        const std::size_t trianglesCount = indices.size() / 3;
+        const std::size_t verticesCount = m_mesh.vertices.size();
+
+        if (trianglesCount == 0)
+            return;
+
+        const VertexScores vertexScore;
+
+        // Triangles of every vertex: adjacency[adjacencyOffsets[v], adjacencyOffsets[v] + listed[v]). Emitted triangles
+        // are dropped from the lists lazily, remaining[v] counts the ones not emitted yet
+        std::vector<std::uint32_t> remaining(verticesCount, 0);
+        for (const VertexIndex vertex : indices)
+            remaining[vertex]++;
+
+        std::vector<std::size_t> adjacencyOffsets(verticesCount + 1, 0);
+        for (std::size_t v = 0; v < verticesCount; v++)
+            adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+
+        std::vector<std::uint32_t> adjacency(indices.size());
+        {
+            std::vector<std::size_t> filled(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (std::size_t i = 0; i < indices.size(); i++)
+                adjacency[filled[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+
+        std::vector<std::uint32_t> listed = remaining;
+
+        std::vector<int> cachePositions(verticesCount, -1);
+        std::vector<float> scores(verticesCount);
+        for (std::size_t v = 0; v < verticesCount; v++)
+            scores[v] = vertexScore(-1, remaining[v]);
+
+        const auto triangleScore = [&indices, &scores](std::size_t triangle)
+        {
+            return scores[indices[3 * triangle]] + scores[indices[3 * triangle + 1]] + scores[indices[3 * triangle + 2]];
+        };
+
+        std::vector<bool> emitted(trianglesCount, false);
+
+        std::vector<VertexIndex> output;
+        output.reserve(indices.size());
+
+        // Three extra entries hold the vertices pushed out of the cache by the emitted triangle
+        std::array<VertexIndex, CACHE_SIZE + 3> cache;
+        std::array<VertexIndex, CACHE_SIZE + 3> newCache;
+        std::size_t cacheSize = 0;
+
+        std::uint32_t best = 0;
+        for (std::uint32_t t = 1; t < trianglesCount; t++)
+            if (triangleScore(t) > triangleScore(best))
+                best = t;
+
+        std::size_t deadEndCursor = 0;
+
+        for (std::size_t emittedCount = 0; emittedCount < trianglesCount; emittedCount++)
+        {
+            // Dead end: nothing in the cache has triangles left, continue with the next one in the input order
+            if (best == NO_TRIANGLE)
+            {
+                while (emitted[deadEndCursor])
+                    deadEndCursor++;
+
+                best = static_cast<std::uint32_t>(deadEndCursor);
+            }
+
+            const VertexIndex triangle[3] = { indices[3 * best], indices[3 * best + 1], indices[3 * best + 2] };
+            output.insert(output.end(), triangle, triangle + 3);
+            emitted[best] = true;
+
+            for (const VertexIndex vertex : triangle)
+                remaining[vertex]--;
+
+            // LRU: the emitted triangle moves to the front
+            std::size_t newCacheSize = 0;
+            for (const VertexIndex vertex : triangle)
+                newCache[newCacheSize++] = vertex;
+
+            for (std::size_t i = 0; i < cacheSize; i++)
+            {
+                const VertexIndex vertex = cache[i];
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                    newCache[newCacheSize++] = vertex;
+            }
+
+            std::swap(cache, newCache);
+            cacheSize = newCacheSize;
+
+            // Rescore vertices whose cache position changed, the ones past the cache size fall out of it
+            for (std::size_t i = 0; i < cacheSize; i++)
+            {
+                const VertexIndex vertex = cache[i];
+                cachePositions[vertex] = i < CACHE_SIZE ? static_cast<int>(i) : -1;
+                scores[vertex] = vertexScore(cachePositions[vertex], remaining[vertex]);
+            }
+
+            // The next triangle is the best one using a cached vertex
+            best = NO_TRIANGLE;
+            float bestScore = 0;
+
+            for (std::size_t i = 0; i < cacheSize; i++)
+            {
+                const VertexIndex vertex = cache[i];
+                std::uint32_t* triangles = &adjacency[adjacencyOffsets[vertex]];
+
+                for (std::uint32_t j = 0; j < listed[vertex] && j < MAX_CANDIDATES_PER_VERTEX;)
+                {
+                    const std::uint32_t adjacent = triangles[j];
+
+                    if (emitted[adjacent])
+                    {
+                        triangles[j] = triangles[--listed[vertex]];
+                        continue;
+                    }
+
+                    j++;
+
+                    const float score = triangleScore(adjacent);
+
+                    if (score > bestScore)
+                    {
+                        best = adjacent;
+                        bestScore = score;
+                    }
+                }
+            }
+
+            cacheSize = (std::min)(cacheSize, static_cast<std::size_t>(CACHE_SIZE));
+        }
+
+        m_mesh.indices = std::move(output);
+    }
+
+    void MeshOptimizer::optimizeVertexFetch()
+    {
+        constexpr VertexIndex UNUSED = (std::numeric_limits<VertexIndex>::max)();
+
+        const std::size_t verticesCount = m_mesh.vertices.size();
+        std::vector<VertexIndex> remap(verticesCount, UNUSED);
+        VertexIndex next = 0;
+
+        for (VertexIndex& vertex : m_mesh.indices)
+        {
+            if (remap[vertex] == UNUSED)
+                remap[vertex] = next++;
+
+            vertex = remap[vertex];
+        }
+
+        // Vertices no triangle refers to go to the end
+        for (VertexIndex& newIndex : remap)
+            if (newIndex == UNUSED)
+                newIndex = next++;
+
+        const auto reorder = [&remap](auto& attributes)
+        {
+            std::remove_reference_t<decltype(attributes)> reordered(attributes.size());
+
+            for (std::size_t i = 0; i < attributes.size(); i++)
+                reordered[remap[i]] = attributes[i];
+
+            attributes = std::move(reordered);
+        };
+
+        reorder(m_mesh.vertices);
+        reorder(m_mesh.normals);
+        reorder(m_mesh.textureVertices);
+    }
+
+    void MeshOptimizer::buildClusters()
+    {
+        const std::vector<VertexIndex>& indices = m_mesh.indices;
+        const std::size_t trianglesCount = indices.size() / 3;
+
+        m_mesh.clusters.clear();
+        m_mesh.clusters.reserve((trianglesCount + MeshCluster::TRIANGLES - 1) / MeshCluster::TRIANGLES);
+
+        for (std::size_t first = 0; first < trianglesCount; first += MeshCluster::TRIANGLES)
+        {
+            const std::size_t last = (std::min)(first + MeshCluster::TRIANGLES, trianglesCount);
+
+            BoundingBox bounds = BoundingBox::empty();
+            VertexIndex minVertex = (std::numeric_limits<VertexIndex>::max)();
+            VertexIndex maxVertex = 0;
+
+            for (std::size_t i = 3 * first; i < 3 * last; i++)
+            {
+                const VertexIndex vertex = indices[i];
+                bounds.extend(static_cast<Vec3<double>>(m_mesh.vertices[vertex]));
+                minVertex = (std::min)(minVertex, vertex);
+                maxVertex = (std::max)(maxVertex, vertex);
+            }
+
+            m_mesh.clusters.push_back({
+                bounds,
+                static_cast<std::uint32_t>(first),
+                static_cast<std::uint32_t>(last - first),
+                minVertex,
+                maxVertex - minVertex + 1
+            });
+        }
+    }
+}
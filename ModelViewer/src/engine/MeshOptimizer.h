@@ -0,0 +1,29 @@
+#pragma once
+#include "pch.h"
+#include "engine/MeshWelder.h"
+
+namespace ModelViewer::Engine
+{
+    // Reorders a welded mesh for the memory access patterns of the renderer. Runs at load time,
+    // the result is what the mesh cache stores.
+    class MeshOptimizer
+    {
+    public:
+        // Vertices considered cached by the triangle order optimization
+        static constexpr int CACHE_SIZE = 32;
+
+    public:
+        MeshOptimizer(WeldedMesh& mesh);
+        // Orders triangles so that consecutive ones share vertices, see Tom Forsyth,
+        // "Linear-Speed Vertex Cache Optimisation"
+        void optimizeVertexCache();
+        // Orders vertices by the first use in the index buffer, so vertex fetches go forward through memory
+        void optimizeVertexFetch();
+        // Splits the index buffer into clusters of MeshCluster::TRIANGLES triangles. After the optimizations above
+        // neighbouring triangles are close to each other and use a narrow range of vertices.
+        void buildClusters();
+
+    private:
+        WeldedMesh& m_mesh;
+    };
+}
@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "MeshWelder.h"
+
+namespace ModelViewer::Engine
+{
+    namespace
+    {
+        template<typename T>
+        T attributeOrDefault(const std::vector<T>& attributes, std::size_t index, const T& defaultValue)
+        {
+            // Corners without texture vertex or normal have index -1 after conversion from OBJ
+            return index < attributes.size() ? attributes[index] : defaultValue;
+        }
+    }
+
+    MeshWelder::MeshWelder(const ParsedObject& object)
+        :
+        m_object(object)
+    {
+    }
+
+    WeldedMesh MeshWelder::weld()
+    {
+        const std::vector<Index>& corners = m_object.indices;
+
+        // Usually every position is shared by a few corners with the same attributes
+        std::size_t capacity = 16;
+        while (capacity < 2 * m_object.vertices.size())
+            capacity <<= 1;
+
+        m_table.assign(capacity, EMPTY);
+        m_corners.clear();
+        m_corners.reserve(m_object.vertices.size());
+
+        WeldedMesh mesh = {};
+        mesh.indices.resize(corners.size());
+
+        for (std::size_t i = 0; i < corners.size(); i++)
+        {
+            std::size_t slot = find(corners[i]);
+
+            if (m_table[slot] == EMPTY)
+            {
+                if (m_corners.size() == EMPTY)
+                    throw std::runtime_error("mesh has too many distinct vertices for 32 bit indices");
+
+                if (2 * (m_corners.size() + 1) > m_table.size())
+                {
+                    grow();
+                    slot = find(corners[i]);
+                }
+
+                m_table[slot] = static_cast<VertexIndex>(m_corners.size());
+                m_corners.push_back(corners[i]);
+            }
+
+            mesh.indices[i] = m_table[slot];
+        }
+
+        mesh.vertices.resize(m_corners.size());
+        mesh.normals.resize(m_corners.size());
+        mesh.textureVertices.resize(m_corners.size());
+
+        for (std::size_t i = 0; i < m_corners.size(); i++)
+        {
+            mesh.vertices[i] = attributeOrDefault(m_object.vertices, m_corners[i].vertex, Vec4<double>({ 0.0, 0.0, 0.0, 1.0 }));
+            mesh.normals[i] = attributeOrDefault(m_object.normals, m_corners[i].normal, Vec3<double>{});
+            mesh.textureVertices[i] = attributeOrDefault(m_object.textureVertices, m_corners[i].texture, Vec3<double>{});
+        }
+
+        m_table = {};
+        m_corners = {};
+
+        return mesh;
+    }
+
+    std::size_t MeshWelder::find(const Index& corner) const
+    {
+        const std::size_t mask = m_table.size() - 1;
+
+        for (std::size_t slot = hash(corner) & mask; ; slot = (slot + 1) & mask)
+        {
+            const VertexIndex vertex = m_table[slot];
+
+            if (vertex == EMPTY)
+                return slot;
+
+            const Index& stored = m_corners[vertex];
+
+            if (stored.vertex == corner.vertex && stored.texture == corner.texture && stored.normal == corner.normal)
+                return slot;
+        }
+    }
+
+    void MeshWelder::grow()
+    {
+        m_table.assign(m_table.size() * 2, EMPTY);
+
+        for (std::size_t i = 0; i < m_corners.size(); i++)
+            m_table[find(m_corners[i])] = static_cast<VertexIndex>(i);
+    }
+
+    std::size_t MeshWelder::hash(const Index& corner)
+    {
+        std::uint64_t h = corner.vertex * 0x9E3779B97F4A7C15ull;
+        h ^= corner.texture * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+        h ^= corner.normal * 0x165667B19E3779F9ull + (h >> 32);
+        h ^= h >> 31;
+
+        return static_cast<std::size_t>(h);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "pch.h"
+#include "math/Vector.h"
+#include "engine/ObjectParser.h"
+#include "engine/MeshCluster.h"
+
+namespace ModelViewer::Engine
+{
+    using VertexIndex = std::uint32_t;
+
+    // Every distinct (v, vt, vn) corner of a parsed object becomes one vertex, all attributes
+    // of a vertex are found by the same index
+    struct WeldedMesh
+    {
+        std::vector<Vec4<double>> vertices;
+        std::vector<Vec3<double>> normals;
+        std::vector<Vec3<double>> textureVertices;
+        std::vector<VertexIndex> indices;
+        // Filled by MeshOptimizer
+        std::vector<MeshCluster> clusters;
+    };
+
+    class MeshWelder
+    {
+    public:
+        MeshWelder(const ParsedObject& object);
+        WeldedMesh weld();
+
+    private:
+        // Open addressing table of vertex indices, keys are stored in m_corners
+        std::size_t find(const Index& corner) const;
+        void grow();
+        static std::size_t hash(const Index& corner);
+
+    private:
+        static constexpr VertexIndex EMPTY = (std::numeric_limits<VertexIndex>::max)();
+
+        const ParsedObject& m_object;
+        std::vector<VertexIndex> m_table;
+        std::vector<Index> m_corners;
+    };
+}
@@ -1,271 +1,315 @@
 #include "pch.h"
 #include "ObjectParser.h"
-
+#include "engine/MappedFile.h"
+#include "ThreadPool.h"
 
 namespace ModelViewer
 {
     namespace Engine
     {
-        ObjectParser::ObjectParser(std::wstring filename)
-            :
-            m_ObjFile(std::move(filename))
-        {
-        }
-
-        ParsedObject ObjectParser::parse()
+        namespace
         {
-            std::wifstream in(m_ObjFile);
-            ParsedObject obj = {};
-            std::vector<SignedIndex> signedIndices;
-
-            for (std::wstring line; std::getline(in, line); )
+            bool isSpace(char c)
             {
-                if (std::wstring_view(line.c_str(), 2) == L"v ")
-                {
-                    obj.vertices.push_back(Vec4<double>(std::move(parseV(line))));
-                } 
-                else if (std::wstring_view(line.c_str(), 3) == L"vn ")
-                {
-                    obj.normals.push_back(Vec3<double>(std::move(parseVN(line))));
-                } 
-                else if (std::wstring_view(line.c_str(), 3) == L"vt ")
-                {
-                    obj.textureVertices.push_back(Vec3<double>(std::move(parseVT(line))));
-                }
-                else if (std::wstring_view(line.c_str(), 2) == L"f ")
-                {
-                    auto f = parseF(line);
+                return c == ' ' || c == '\t';
+            }
 
-                    for (const auto& a: f)
-                        signedIndices.push_back({a[0], a[1], a[2]});
-                }
+            // Comments may follow the values of a statement
+            bool isLineEnd(char c)
+            {
+                return c == '\n' || c == '\r' || c == '#';
             }
 
-            obj.indices = convertToUnsignedIndices(signedIndices, obj.vertices.size(), obj.textureVertices.size(), obj.normals.size());
+            bool isStatement(const char* p, const char* end, std::string_view keyword)
+            {
+                return static_cast<std::size_t>(end - p) > keyword.size() && std::string_view(p, keyword.size()) == keyword
+                    && isSpace(p[keyword.size()]);
+            }
 
-            return obj;
-        }
+            const char* skipSpaces(const char* p, const char* end)
+            {
+                while (p < end && isSpace(*p))
+                    p++;
 
-        std::array<int, 3> ObjectParser::parseFSingle(const std::wstring& str) const
-        {
-            constexpr const size_t MAX_F_INDICES = 3;
-            std::array<int, MAX_F_INDICES> f = {};
-            std::size_t offset = 0;
+                return p;
+            }
 
-            for (size_t i = 0; i < MAX_F_INDICES - 1; i++)
+            const char* skipLine(const char* p, const char* end)
             {
-                auto pos = str.find(L'/', offset);
-
-                if (pos == std::wstring::npos)
-                    break;
+                const char* newLine = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                return newLine ? newLine + 1 : end;
+            }
 
-                f[i] = std::stoi(str.substr(offset, pos - offset));
-                offset = pos + 1;
+            [[noreturn]] void throwParseError(const char* begin, const char* p)
+            {
+                const auto line = std::count(begin, p, '\n') + 1;
+                throw std::runtime_error("invalid obj file at line " + std::to_string(line));
             }
 
-            f[MAX_F_INDICES - 1] = std::stoi(str.substr(offset));
+            template<typename T>
+            const char* parseNumber(const char* begin, const char* p, const char* end, T& value)
+            {
+                // from_chars doesn't accept the plus sign
+                if (p < end && *p == '+')
+                    p++;
 
-            return f;
-        }
+                const auto [next, error] = std::from_chars(p, end, value);
 
-        std::vector<std::array<int, 3>> ObjectParser::parseF(const std::wstring& str) const
-        {
-            std::vector<std::array<int, 3>> f = {};
-            std::size_t offsetFromTheBeginingOfTheLine = 2;
+                if (error != std::errc())
+                    throwParseError(begin, p);
 
-            // Skip spaces after "f ", prevent from parsing empty string
-            while (offsetFromTheBeginingOfTheLine < str.size() && str[offsetFromTheBeginingOfTheLine] == L' ')
-            {
-                offsetFromTheBeginingOfTheLine++;
-                if (offsetFromTheBeginingOfTheLine == str.size())
-                    offsetFromTheBeginingOfTheLine = std::wstring::npos;
+                return next;
             }
 
-            if (offsetFromTheBeginingOfTheLine == std::wstring::npos)
-                return f;
-
-            while (true)
+            // Reads up to Size numbers till the end of the line, missing ones keep their values
+            template<std::size_t Size>
+            const char* parseVector(const char* begin, const char* p, const char* end, Vector<double, Size>& vector)
             {
-                auto pos = str.find(L' ', offsetFromTheBeginingOfTheLine);
+                p = skipSpaces(p, end);
 
-                if (pos == std::wstring::npos)
-                    break;
-
-                // Skip spaces
-                while (pos + 1 < str.size() && str[pos + 1] == L' ')
+                for (std::size_t i = 0; i < Size && p < end && !isLineEnd(*p); i++)
                 {
-                    pos++;
-                    if (pos + 1 == str.size())
-                        pos = std::wstring::npos;
+                    p = parseNumber(begin, p, end, vector[i]);
+                    p = skipSpaces(p, end);
                 }
 
-                if (pos == std::wstring::npos)
-                    break;
-
-                f.push_back(parseFSingle(str.substr(offsetFromTheBeginingOfTheLine, pos - offsetFromTheBeginingOfTheLine)));
-
-                offsetFromTheBeginingOfTheLine = pos + 1;
+                return p;
             }
 
-            f.push_back(parseFSingle(str.substr(offsetFromTheBeginingOfTheLine)));
-
-            return f;
-        }
-
-        Vec4<double> ObjectParser::parseV(const std::wstring& str)
-        {
-            constexpr int MAX_COUNT_COORDS = 4;
-            std::size_t offsetFromTheBeginingOfTheLine = 2;
-            Vec4<double> vertex({0.0, 0.0, 0.0, 1.0});
-            std::size_t countCoords = 0;
-
-            // Skip spaces after "v ", prevent from parsing empty string
-            while (offsetFromTheBeginingOfTheLine < str.size() && str[offsetFromTheBeginingOfTheLine] == L' ')
+            // OBJ indices start from 1, negative ones count back from the last element defined so far
+            std::size_t toUnsignedIndex(int index, std::size_t count)
             {
-                offsetFromTheBeginingOfTheLine++;
-                if (offsetFromTheBeginingOfTheLine == str.size())
-                    offsetFromTheBeginingOfTheLine = std::wstring::npos;
+                return index < 0 ? count + index : index - 1;
             }
 
-            if (offsetFromTheBeginingOfTheLine == std::wstring::npos)
-                return vertex;
-
-            for (int i = 0; i < MAX_COUNT_COORDS - 1; i++)
+            // v, v/vt, v//vn or v/vt/vn, missing indices are 0
+            const char* parseFaceVertex(const char* begin, const char* p, const char* end, SignedIndex& index)
             {
-                auto pos = str.find(L' ', offsetFromTheBeginingOfTheLine);
+                index = {};
+                p = parseNumber(begin, p, end, index.vertex);
 
-                if (pos == std::wstring::npos)
-                    break;
+                if (p == end || *p != '/')
+                    return p;
 
-                // Skip spaces
-                while (pos + 1 < str.size() && str[pos + 1] == L' ')
-                {
-                    pos++;
-                    if (pos + 1 == str.size())
-                        pos = std::wstring::npos;
-                }
+                p++;
 
-                if (pos == std::wstring::npos)
-                    break;
+                if (p < end && *p != '/')
+                    p = parseNumber(begin, p, end, index.texture);
 
-                vertex[i] = std::stod(str.substr(offsetFromTheBeginingOfTheLine, pos - offsetFromTheBeginingOfTheLine));
+                if (p == end || *p != '/')
+                    return p;
 
-                offsetFromTheBeginingOfTheLine = pos + 1;
-                countCoords++;
+                return parseNumber(begin, p + 1, end, index.normal);
             }
 
-            vertex[countCoords] = std::stod(str.substr(offsetFromTheBeginingOfTheLine));
-
-            return vertex;
-        }
-
-        Vec3<double> ObjectParser::parseVN(const std::wstring& str)
-        {
-            constexpr int MAX_COUNT_COORDS = 3;
-            std::size_t offsetFromTheBeginingOfTheLine = 3;
-            Vec3<double> normal{};
-            std::size_t countCoords = 0;
-
-            // Skip spaces after "vn ", prevent from parsing empty string
-            while (offsetFromTheBeginingOfTheLine < str.size() && str[offsetFromTheBeginingOfTheLine] == L' ')
+            // Lines of the file parsed by one task. The first pass counts the elements, the prefix sum of the
+            // counts gives the place of the chunk in the output and resolves negative indices in the second pass.
+            struct Chunk
             {
-                offsetFromTheBeginingOfTheLine++;
-                if (offsetFromTheBeginingOfTheLine == str.size())
-                    offsetFromTheBeginingOfTheLine = std::wstring::npos;
-            }
-
-            if (offsetFromTheBeginingOfTheLine == std::wstring::npos)
-                return normal;
-
-            for (int i = 0; i < MAX_COUNT_COORDS - 1; i++)
+                struct Counts
+                {
+                    std::size_t vertices;
+                    std::size_t textureVertices;
+                    std::size_t normals;
+                    std::size_t indices;
+                };
+
+                const char* begin;
+                const char* end;
+                Counts counts;
+                Counts first;
+                std::exception_ptr error;
+            };
+
+            std::vector<Chunk> splitIntoChunks(const char* begin, const char* end, std::size_t chunkSize)
             {
-                auto pos = str.find(L' ', offsetFromTheBeginingOfTheLine);
+                std::vector<Chunk> chunks;
+                chunks.reserve((end - begin) / chunkSize + 1);
 
-                if (pos == std::wstring::npos)
-                    break;
-
-                // Skip spaces
-                while (pos + 1 < str.size() && str[pos + 1] == L' ')
+                for (const char* p = begin; p < end; )
                 {
-                    pos++;
-                    if (pos + 1 == str.size())
-                        pos = std::wstring::npos;
+                    const char* next = static_cast<std::size_t>(end - p) > chunkSize ? skipLine(p + chunkSize, end) : end;
+                    chunks.push_back({ p, next, {}, {}, nullptr });
+                    p = next;
                 }
 
-                if (pos == std::wstring::npos)
-                    break;
-
-                normal[i] = std::stod(str.substr(offsetFromTheBeginingOfTheLine, pos - offsetFromTheBeginingOfTheLine));
-
-                offsetFromTheBeginingOfTheLine = pos + 1;
-                countCoords++;
+                return chunks;
             }
 
-            normal[countCoords] = std::stod(str.substr(offsetFromTheBeginingOfTheLine));
+            std::size_t countFaceIndices(const char* p, const char* end)
+            {
+                std::size_t vertices = 0;
 
-            return normal;
-        }
+                for (p = skipSpaces(p, end); p < end && !isLineEnd(*p); p = skipSpaces(p, end))
+                {
+                    vertices++;
 
-        Vec3<double> ObjectParser::parseVT(const std::wstring& str)
-        {
-            constexpr int MAX_COUNT_COORDS = 3;
-            std::size_t offsetFromTheBeginingOfTheLine = 3;
-            Vec3<double> textureVertex{};
-            std::size_t countCoords = 0;
+                    while (p < end && !isSpace(*p) && !isLineEnd(*p))
+                        p++;
+                }
 
-            // Skip spaces after "vt ", prevent from parsing empty string
-            while (offsetFromTheBeginingOfTheLine < str.size() && str[offsetFromTheBeginingOfTheLine] == L' ')
-            {
-                offsetFromTheBeginingOfTheLine++;
-                if (offsetFromTheBeginingOfTheLine == str.size())
-                    offsetFromTheBeginingOfTheLine = std::wstring::npos;
+                return vertices >= 3 ? (vertices - 2) * 3 : 0;
             }
 
-            if (offsetFromTheBeginingOfTheLine == std::wstring::npos)
-                return textureVertex;
-
-            for (int i = 0; i < MAX_COUNT_COORDS - 1; i++)
+            void countChunk(Chunk& chunk)
             {
-                auto pos = str.find(L' ', offsetFromTheBeginingOfTheLine);
+                const char* const end = chunk.end;
 
-                if (pos == std::wstring::npos)
-                    break;
-
-                // Skip spaces
-                while (pos + 1 < str.size() && str[pos + 1] == L' ')
+                for (const char* p = chunk.begin; p < end; p = skipLine(p, end))
                 {
-                    pos++;
-                    if (pos + 1 == str.size())
-                        pos = std::wstring::npos;
+                    p = skipSpaces(p, end);
+
+                    if (isStatement(p, end, "v"))
+                        chunk.counts.vertices++;
+                    else if (isStatement(p, end, "vt"))
+                        chunk.counts.textureVertices++;
+                    else if (isStatement(p, end, "vn"))
+                        chunk.counts.normals++;
+                    else if (isStatement(p, end, "f"))
+                        chunk.counts.indices += countFaceIndices(p + 2, end);
                 }
+            }
 
-                if (pos == std::wstring::npos)
-                    break;
-
-                textureVertex[i] = std::stod(str.substr(offsetFromTheBeginingOfTheLine, pos - offsetFromTheBeginingOfTheLine));
+            // Writes the elements of the chunk to their final places in obj. Counters are global, so they
+            // resolve negative indices the same way as when the file is read from the beginning.
+            void parseChunk(const char* fileBegin, const Chunk& chunk, ParsedObject& obj)
+            {
+                const char* const end = chunk.end;
+                const std::size_t lastIndex = chunk.first.indices + chunk.counts.indices;
+                Chunk::Counts next = chunk.first;
 
-                offsetFromTheBeginingOfTheLine = pos + 1;
-                countCoords++;
+                for (const char* p = chunk.begin; p < end; p = skipLine(p, end))
+                {
+                    p = skipSpaces(p, end);
+
+                    if (isStatement(p, end, "v"))
+                    {
+                        Vec4<double> vertex({ 0.0, 0.0, 0.0, 1.0 });
+                        p = parseVector(fileBegin, p + 2, end, vertex);
+                        obj.vertices[next.vertices++] = vertex;
+                    }
+                    else if (isStatement(p, end, "vn"))
+                    {
+                        Vec3<double> normal{};
+                        p = parseVector(fileBegin, p + 3, end, normal);
+                        obj.normals[next.normals++] = normal;
+                    }
+                    else if (isStatement(p, end, "vt"))
+                    {
+                        Vec3<double> textureVertex{};
+                        p = parseVector(fileBegin, p + 3, end, textureVertex);
+                        obj.textureVertices[next.textureVertices++] = textureVertex;
+                    }
+                    else if (isStatement(p, end, "f"))
+                    {
+                        // Polygons are split into a triangle fan
+                        Index first = {};
+                        Index previous = {};
+                        std::size_t count = 0;
+
+                        for (p = skipSpaces(p + 2, end); p < end && !isLineEnd(*p); p = skipSpaces(p, end), count++)
+                        {
+                            SignedIndex signedIndex;
+                            p = parseFaceVertex(fileBegin, p, end, signedIndex);
+
+                            const Index current = {
+                                toUnsignedIndex(signedIndex.vertex, next.vertices),
+                                toUnsignedIndex(signedIndex.texture, next.textureVertices),
+                                toUnsignedIndex(signedIndex.normal, next.normals)
+                            };
+
+                            if (count == 0)
+                            {
+                                first = current;
+                            }
+                            else if (count >= 2)
+                            {
+                                // Malformed vertices like "1-2" are read as two of them
+                                if (next.indices == lastIndex)
+                                    throwParseError(fileBegin, p);
+
+                                obj.indices[next.indices++] = first;
+                                obj.indices[next.indices++] = previous;
+                                obj.indices[next.indices++] = current;
+                            }
+
+                            previous = current;
+                        }
+                    }
+                }
             }
 
-            textureVertex[countCoords] = std::stod(str.substr(offsetFromTheBeginingOfTheLine));
+            template<typename TFunction>
+            void forEachChunk(ThreadPool* pool, std::vector<Chunk>& chunks, const TFunction& function)
+            {
+                // Tasks must not throw, errors are passed to the calling thread
+                const auto run = [&chunks, &function](std::size_t firstChunk, std::size_t lastChunk)
+                {
+                    for (std::size_t i = firstChunk; i < lastChunk; i++)
+                    {
+                        try
+                        {
+                            function(chunks[i]);
+                        }
+                        catch (...)
+                        {
+                            chunks[i].error = std::current_exception();
+                        }
+                    }
+                };
+
+                if (pool)
+                    pool->parallelFor(0, chunks.size(), 1, run);
+                else
+                    run(0, chunks.size());
+
+                for (const Chunk& chunk : chunks)
+                    if (chunk.error)
+                        std::rethrow_exception(chunk.error);
+            }
+        }
 
-            return textureVertex;
+        ObjectParser::ObjectParser(std::filesystem::path filename, ThreadPool* pool)
+            :
+            m_ObjFile(std::move(filename)),
+            m_pool(pool)
+        {
         }
 
-        std::vector<Index> ObjectParser::convertToUnsignedIndices(const std::vector<SignedIndex>& signedIndices,
-            std::size_t verticesCount, std::size_t textureVerticesCount, std::size_t normalsCount) const
+        ParsedObject ObjectParser::parse()
         {
-            std::vector<Index> indices(signedIndices.size());
+            const MappedFile file(m_ObjFile);
+            const char* const fileBegin = file.getData();
+            const char* begin = fileBegin;
+            const char* const end = begin + file.getSize();
+
+            // UTF-8 byte order mark
+            if (end - begin >= 3 && std::string_view(begin, 3) == "\xEF\xBB\xBF")
+                begin += 3;
+
+            std::vector<Chunk> chunks = splitIntoChunks(begin, end, CHUNK_SIZE);
 
-            for (std::size_t i = 0; i < signedIndices.size(); i++)
+            forEachChunk(m_pool, chunks, [](Chunk& chunk) { countChunk(chunk); });
+
+            Chunk::Counts total = {};
+            for (Chunk& chunk : chunks)
             {
-                indices[i].vertex = signedIndices[i].vertex < 0 ? verticesCount + signedIndices[i].vertex : signedIndices[i].vertex - 1;
-                indices[i].texture = signedIndices[i].texture < 0 ? textureVerticesCount + signedIndices[i].texture : signedIndices[i].texture - 1;
-                indices[i].normal = signedIndices[i].normal < 0 ? normalsCount + signedIndices[i].normal : signedIndices[i].normal - 1;
+                chunk.first = total;
+                total.vertices += chunk.counts.vertices;
+                total.textureVertices += chunk.counts.textureVertices;
+                total.normals += chunk.counts.normals;
+                total.indices += chunk.counts.indices;
             }
 
-            return indices;
+            ParsedObject obj = {};
+            obj.vertices.resize(total.vertices);
+            obj.textureVertices.resize(total.textureVertices);
+            obj.normals.resize(total.normals);
+            obj.indices.resize(total.indices);
+
+            forEachChunk(m_pool, chunks, [fileBegin, &obj](Chunk& chunk) { parseChunk(fileBegin, chunk, obj); });
+
+            return obj;
         }
     }
 }
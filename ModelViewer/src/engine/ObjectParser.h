@@ -2,6 +2,8 @@
 #include "pch.h"
 #include "math/Vector.h"
 
+class ThreadPool;
+
 namespace ModelViewer
 {
     namespace Engine
@@ -27,20 +29,17 @@ namespace ModelViewer
         class ObjectParser
         {
         public:
-            ObjectParser(std::wstring filename);
+            // Bytes of the file parsed by one task
+            static constexpr std::size_t CHUNK_SIZE = 1 << 22;
+
+        public:
+            // Chunks of the file are parsed on the pool when it is given
+            ObjectParser(std::filesystem::path filename, ThreadPool* pool = nullptr);
             ParsedObject parse();
 
         private:
-            std::array<int, 3> parseFSingle(const std::wstring& str) const;
-            std::vector<std::array<int, 3>> parseF(const std::wstring& str) const;
-            Vec4<double> parseV(const std::wstring& str);
-            Vec3<double> parseVN(const std::wstring& str);
-            Vec3<double> parseVT(const std::wstring& str);
-            std::vector<Index> convertToUnsignedIndices(const std::vector<SignedIndex>& signedIndices, 
-                std::size_t verticesCount, std::size_t textureVerticesCount, std::size_t normalsCount) const;
-            
-        private:
-            std::wstring m_ObjFile;
+            std::filesystem::path m_ObjFile;
+            ThreadPool* m_pool;
             bool m_Parsed = false;
         };
     }
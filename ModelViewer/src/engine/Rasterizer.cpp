@@ -29,25 +29,492 @@ namespace ModelViewer
             expect(checkVec2(vec, screenWidth, screenHeight));
         }
 
+        // Half-space rasterization works in 28.4 fixed point
+        constexpr int SUBPIXEL_BITS = 4;
+        constexpr std::int64_t SUBPIXEL_SCALE = 1 << SUBPIXEL_BITS;
+        constexpr std::int64_t HALF_PIXEL = SUBPIXEL_SCALE / 2;
+        constexpr int BLOCK_SIZE = 8;
+
+        // Rotated grid of 4x MSAA, offsets from the pixel center in 28.4 fixed point
+        constexpr int SAMPLE_OFFSETS[Rasterizer::SAMPLE_COUNT][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+
+        // Vertices further away than this (in pixels) would overflow 64-bit edge arithmetic
+        constexpr double GUARD_BAND = 1 << 20;
+
+        // E(x, y) = A * x + B * y + C, evaluated at the center of pixel (x, y). E >= 0 inside
+        // of the triangle for vertices ordered so that the triangle area is positive.
+        struct EdgeFunction
+        {
+            std::int64_t stepX;
+            std::int64_t stepY;
+            std::int64_t origin;
+
+            // Top-left fill rule: pixels exactly on a right or bottom edge are not covered
+            std::int64_t bias;
+
+            EdgeFunction(std::int64_t x0, std::int64_t y0, std::int64_t x1, std::int64_t y1)
+            {
+                const std::int64_t a = y0 - y1;
+                const std::int64_t b = x1 - x0;
+                const std::int64_t c = x0 * y1 - y0 * x1;
+
+                stepX = a * SUBPIXEL_SCALE;
+                stepY = b * SUBPIXEL_SCALE;
+                origin = a * HALF_PIXEL + b * HALF_PIXEL + c;
+
+                const bool isTopEdge = a == 0 && b > 0;
+                const bool isLeftEdge = a > 0;
+                bias = isTopEdge || isLeftEdge ? 0 : -1;
+            }
+
+            std::int64_t at(int x, int y) const
+            {
+                return origin + stepX * x + stepY * y;
+            }
+
+            // Change of the value from the pixel center to a point offset by (dx, dy) in 28.4 fixed point
+            std::int64_t offset(int dx, int dy) const
+            {
+                return (stepX * dx + stepY * dy) / SUBPIXEL_SCALE;
+            }
+        };
+
+        // Vertices in 28.4 fixed point, ordered so that the triangle area is positive and
+        // inside is E >= 0 for every edge. Vertex i is vertex order[i] of the input.
+        struct FixedTriangle
+        {
+            std::array<std::int64_t, 3> xs;
+            std::array<std::int64_t, 3> ys;
+            std::array<int, 3> order = { 0, 1, 2 };
+            // Twice the area in 28.4 fixed point, 0 for degenerate triangles
+            std::int64_t area;
+
+            FixedTriangle(const Vec4<double>& a, const Vec4<double>& b, const Vec4<double>& c)
+                :
+                xs({ toFixed(a[X]), toFixed(b[X]), toFixed(c[X]) }),
+                ys({ toFixed(a[Y]), toFixed(b[Y]), toFixed(c[Y]) })
+            {
+                area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (ys[1] - ys[0]) * (xs[2] - xs[0]);
+
+                if (area < 0)
+                {
+                    std::swap(xs[1], xs[2]);
+                    std::swap(ys[1], ys[2]);
+                    std::swap(order[1], order[2]);
+                    area = -area;
+                }
+            }
+
+            // Edge i is opposite to vertex i, so its value is the barycentric weight of vertex i
+            std::array<EdgeFunction, 3> getEdges() const
+            {
+                return {
+                    EdgeFunction(xs[1], ys[1], xs[2], ys[2]),
+                    EdgeFunction(xs[2], ys[2], xs[0], ys[0]),
+                    EdgeFunction(xs[0], ys[0], xs[1], ys[1])
+                };
+            }
+
+            static std::int64_t toFixed(double coordinate)
+            {
+                return static_cast<std::int64_t>(std::llround(coordinate * SUBPIXEL_SCALE));
+            }
+        };
+
+        // Screen-space linear attribute: value(x, y) = origin + stepX * x + stepY * y
+        struct AttributePlane
+        {
+            double stepX = 0;
+            double stepY = 0;
+            double origin = 0;
+
+            AttributePlane() = default;
+
+            // The same value everywhere
+            explicit AttributePlane(double value)
+                :
+                origin(value)
+            {
+            }
+
+            AttributePlane(double valueA, double valueB, double valueC, const std::array<EdgeFunction, 3>& edges, double area)
+                :
+                stepX((valueA * edges[0].stepX + valueB * edges[1].stepX + valueC * edges[2].stepX) / area),
+                stepY((valueA * edges[0].stepY + valueB * edges[1].stepY + valueC * edges[2].stepY) / area),
+                origin((valueA * edges[0].origin + valueB * edges[1].origin + valueC * edges[2].origin) / area)
+            {
+            }
+
+            double at(int x, int y) const
+            {
+                return origin + stepX * x + stepY * y;
+            }
+        };
+
+        SpanValue makeSpanValue(double value, double stepX)
+        {
+            return { static_cast<float>(value), static_cast<float>(stepX) };
+        }
+
+        // Attributes of the span kernels over a triangle. Depth is interpolated linearly in screen space,
+        // the rest of the attributes are perspective correct.
+        struct TrianglePlanes
+        {
+            AttributePlane z;
+            AttributePlane invZ;
+            AttributePlane u;
+            AttributePlane v;
+            AttributePlane worldX;
+            AttributePlane worldY;
+            AttributePlane worldZ;
+
+            TrianglePlanes() = default;
+
+            // Vertices are in the order of the edges
+            TrianglePlanes(const std::array<EdgeFunction, 3>& edges, double area,
+                const std::array<std::reference_wrapper<const Vec4<double>>, 3>& vertices,
+                const std::array<std::reference_wrapper<const Vec3<double>>, 3>& worldVertices,
+                const std::array<std::reference_wrapper<const Vec3<double>>, 3>& uvs)
+            {
+                const std::array<double, 3> zs = { vertices[0].get()[Z], vertices[1].get()[Z], vertices[2].get()[Z] };
+                const std::array<double, 3> invZs = { 1 / zs[0], 1 / zs[1], 1 / zs[2] };
+
+                const auto makePlane = [&edges, area](double valueA, double valueB, double valueC)
+                {
+                    return AttributePlane(valueA, valueB, valueC, edges, area);
+                };
+
+                const auto makePerspectivePlane = [&makePlane, &invZs](double valueA, double valueB, double valueC)
+                {
+                    return makePlane(valueA * invZs[0], valueB * invZs[1], valueC * invZs[2]);
+                };
+
+                z = makePlane(zs[0], zs[1], zs[2]);
+                invZ = makePlane(invZs[0], invZs[1], invZs[2]);
+                u = makePerspectivePlane(uvs[0].get()[U], uvs[1].get()[U], uvs[2].get()[U]);
+                v = makePerspectivePlane(uvs[0].get()[V], uvs[1].get()[V], uvs[2].get()[V]);
+                worldX = makePerspectivePlane(worldVertices[0].get()[X], worldVertices[1].get()[X], worldVertices[2].get()[X]);
+                worldY = makePerspectivePlane(worldVertices[0].get()[Y], worldVertices[1].get()[Y], worldVertices[2].get()[Y]);
+                worldZ = makePerspectivePlane(worldVertices[0].get()[Z], worldVertices[1].get()[Z], worldVertices[2].get()[Z]);
+            }
+
+            SpanAttributes at(int x, int y) const
+            {
+                return {
+                    z.at(x, y),
+                    z.stepX,
+                    makeSpanValue(invZ.at(x, y), invZ.stepX),
+                    makeSpanValue(u.at(x, y), u.stepX),
+                    makeSpanValue(v.at(x, y), v.stepX),
+                    makeSpanValue(worldX.at(x, y), worldX.stepX),
+                    makeSpanValue(worldY.at(x, y), worldY.stepX),
+                    makeSpanValue(worldZ.at(x, y), worldZ.stepX)
+                };
+            }
+        };
+
+        SpanShader makeSpanShader(const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap,
+            std::uint32_t material, const Matrix3<double>& normalMatrix, const Light::LightingState& lighting, DepthPass pass)
+        {
+            SpanShader shader = {
+                { reinterpret_cast<const std::uint8_t*>(diffuseMap.data.data()),
+                    static_cast<std::int32_t>(diffuseMap.width), static_cast<std::int32_t>(diffuseMap.height) },
+                { reinterpret_cast<const double*>(normalMap.data.data()),
+                    static_cast<std::int32_t>(normalMap.width), static_cast<std::int32_t>(normalMap.height) },
+                { specularMap.data.data(), static_cast<std::int32_t>(specularMap.width), static_cast<std::int32_t>(specularMap.height) },
+                {},
+                lighting.span,
+                pass == DepthPass::SHADING ? SpanDepthTest::EQUAL : SpanDepthTest::LESS,
+                material
+            };
+
+            // Matrices are indexed as (column, row)
+            for (int row = 0; row < 3; row++)
+                for (int column = 0; column < 3; column++)
+                    shader.normalMatrix[row][column] = static_cast<float>(normalMatrix(column, row));
+
+            return shader;
+        }
+
+        // Depth test of the samples of a span as testDepth of the span kernels does it for pixels. Bit
+        // SAMPLE_COUNT * i + s of coverage is sample s of pixel i, returns the passing samples.
+        template<typename TDepth>
+        unsigned testSamples(SpanDepthTest depthTest, double spanZ, double zStepX,
+            const std::array<double, Rasterizer::SAMPLE_COUNT>& zOffsets, unsigned coverage, TDepth* depth)
+        {
+            using Encoding = DepthEncoding<TDepth>;
+
+            constexpr unsigned PIXEL_SAMPLES = (1u << Rasterizer::SAMPLE_COUNT) - 1;
+            const bool isEqualTest = depthTest == SpanDepthTest::EQUAL;
+            unsigned passed = 0;
+
+            for (int i = 0; i < SPAN_WIDTH; i++)
+            {
+                if (!(coverage >> (Rasterizer::SAMPLE_COUNT * i) & PIXEL_SAMPLES))
+                    continue;
+
+                const double pixelZ = spanZ + zStepX * i;
+
+                for (int s = 0; s < Rasterizer::SAMPLE_COUNT; s++)
+                {
+                    const int sample = Rasterizer::SAMPLE_COUNT * i + s;
+                    const double z = pixelZ + zOffsets[s];
+
+                    if (!(coverage & 1u << sample) || z <= 0)
+                        continue;
+
+                    const TDepth encoded = Encoding::encode(z);
+
+                    if (isEqualTest ? depth[sample] != encoded : !Encoding::isInFront(encoded, depth[sample]))
+                        continue;
+
+                    depth[sample] = isEqualTest ? -encoded : encoded;
+                    passed |= 1u << sample;
+                }
+            }
+
+            return passed;
+        }
+
+        thread_local ShadingCounters s_shadingCounters = {};
+
         Rasterizer::Rasterizer(int width, int height)
             :
             m_width(width),
             m_height(height),
-            m_data(width * height),
-            m_zBuffer(width * height)
+            m_frameBuffer(width, height),
+            m_data(m_frameBuffer.getColorData()),
+            m_depthData(static_cast<std::uint8_t*>(m_frameBuffer.getDepthData())),
+            m_depthSize(sizeof(double)),
+            m_shadeSpan(selectShadeSpanKernel<double>()),
+            m_depthSpan(selectDepthSpanKernel<double>()),
+            m_gBufferSpan(selectGBufferSpanKernel<double>()),
+            m_lightSpan(selectLightSpanKernel<double>()),
+            m_visibilitySpan(selectVisibilitySpanKernel<double>()),
+            m_countTilesX((width + TileBinner::TILE_SIZE - 1) / TileBinner::TILE_SIZE),
+            // Depth of a new frame buffer is not cleared
+            m_tileStates(static_cast<std::size_t>(m_countTilesX) * ((height + TileBinner::TILE_SIZE - 1) / TileBinner::TILE_SIZE), TileState::STALE)
         {
         }
 
+        void Rasterizer::setDepthFormat(DepthFormat format)
+        {
+            m_frameBuffer.setDepthFormat(format);
+            m_depthData = static_cast<std::uint8_t*>(m_frameBuffer.getDepthData());
+            std::fill(m_tileStates.begin(), m_tileStates.end(), TileState::STALE);
+
+            if (m_samples)
+                m_samples->setDepthFormat(format);
+
+            // Kernels test depth in the format of the buffer
+            m_frameBuffer.visitDepth([this](auto* depth)
+            {
+                using Depth = std::decay_t<decltype(*depth)>;
+
+                m_depthSize = sizeof(Depth);
+                m_shadeSpan = selectShadeSpanKernel<Depth>();
+                m_depthSpan = selectDepthSpanKernel<Depth>();
+                m_gBufferSpan = selectGBufferSpanKernel<Depth>();
+                m_lightSpan = selectLightSpanKernel<Depth>();
+                m_visibilitySpan = selectVisibilitySpanKernel<Depth>();
+            });
+        }
+
         void Rasterizer::begin()
         {
-            std::memset(m_data.data(), 0, m_data.size() * sizeof(unsigned));
-            m_zBuffer.assign(m_zBuffer.size(), (std::numeric_limits<double>::max)());
+            for (TileState& state : m_tileStates)
+            {
+                if (state == TileState::DRAWN)
+                    state = TileState::STALE;
+            }
+        }
+
+        void Rasterizer::end()
+        {
+            for (std::size_t tileIndex = 0; tileIndex < m_tileStates.size(); tileIndex++)
+            {
+                if (m_tileStates[tileIndex] != TileState::STALE)
+                    continue;
+
+                const int left = static_cast<int>(tileIndex % m_countTilesX) * TileBinner::TILE_SIZE;
+                const int top = static_cast<int>(tileIndex / m_countTilesX) * TileBinner::TILE_SIZE;
+                clearTile({ left, top, (std::min)(left + TileBinner::TILE_SIZE, m_width), (std::min)(top + TileBinner::TILE_SIZE, m_height) });
+                m_tileStates[tileIndex] = TileState::CLEARED;
+            }
+
+            // Frame buffer holds the final image, presenting it is up to the caller
+        }
+
+        void Rasterizer::beginTile(const Tile& tile)
+        {
+            TileState& state = m_tileStates[getTileIndex(tile)];
+
+            if (state == TileState::STALE)
+                clearTile(tile);
+
+            state = TileState::DRAWN;
+        }
+
+        bool Rasterizer::isTileDrawn(const Tile& tile) const
+        {
+            return m_tileStates[getTileIndex(tile)] == TileState::DRAWN;
+        }
+
+        void Rasterizer::clearTile(const Tile& tile)
+        {
+            m_frameBuffer.clear(tile.left, tile.top, tile.right, tile.bottom);
+
+            if (m_multisampling)
+                m_samples->clear(SAMPLE_COUNT * tile.left, tile.top, SAMPLE_COUNT * tile.right, tile.bottom);
         }
 
-        void Rasterizer::end(Gdiplus::Graphics& gfx)
+        void Rasterizer::setMultisampling(bool enabled)
         {
-            Gdiplus::Bitmap bitmap(m_width, m_height, m_width * STRIDE, PixelFormat32bppRGB, reinterpret_cast<BYTE*>(m_data.data()));
-            gfx.DrawImage(&bitmap, 0, 0, m_width, m_height);
+            if (enabled == m_multisampling)
+                return;
+
+            m_multisampling = enabled;
+
+            if (!enabled)
+                return;
+
+            if (!m_samples)
+                m_samples.emplace(SAMPLE_COUNT * m_width, m_height);
+
+            m_samples->setDepthFormat(m_frameBuffer.getDepthFormat());
+
+            // Samples are left from the last time multisampling was enabled
+            std::fill(m_tileStates.begin(), m_tileStates.end(), TileState::STALE);
+        }
+
+        void Rasterizer::resolveSamples(const Tile& tile)
+        {
+            expect(m_multisampling);
+
+            const unsigned* const sampleColors = m_samples->getColorData();
+
+            for (int y = tile.top; y < tile.bottom; y++)
+            {
+                for (int x = tile.left; x < tile.right; x++)
+                {
+                    const std::size_t offset = static_cast<std::size_t>(y) * m_width + x;
+                    const unsigned* const samples = sampleColors + SAMPLE_COUNT * offset;
+
+                    unsigned red = SAMPLE_COUNT / 2;
+                    unsigned green = SAMPLE_COUNT / 2;
+                    unsigned blue = SAMPLE_COUNT / 2;
+
+                    for (int s = 0; s < SAMPLE_COUNT; s++)
+                    {
+                        red += (samples[s] >> 16) & 0xFF;
+                        green += (samples[s] >> 8) & 0xFF;
+                        blue += samples[s] & 0xFF;
+                    }
+
+                    m_data[offset] = (red / SAMPLE_COUNT) << 16 | (green / SAMPLE_COUNT) << 8 | blue / SAMPLE_COUNT;
+                }
+            }
+
+            m_frameBuffer.visitDepth([this, &tile](auto* depth)
+            {
+                using Depth = std::decay_t<decltype(*depth)>;
+                const Depth* const sampleDepths = static_cast<const Depth*>(m_samples->getDepthData());
+
+                for (int y = tile.top; y < tile.bottom; y++)
+                {
+                    for (int x = tile.left; x < tile.right; x++)
+                    {
+                        const std::size_t offset = static_cast<std::size_t>(y) * m_width + x;
+                        const Depth* const samples = sampleDepths + SAMPLE_COUNT * offset;
+
+                        Depth farthest = samples[0];
+                        for (int s = 1; s < SAMPLE_COUNT; s++)
+                            if (DepthEncoding<Depth>::isInFront(farthest, samples[s]))
+                                farthest = samples[s];
+
+                        depth[offset] = farthest;
+                    }
+                }
+            });
+        }
+
+        void Rasterizer::setProfiling(bool enabled)
+        {
+            m_profiling = enabled;
+        }
+
+        ShadingCounters Rasterizer::getShadingCounters()
+        {
+            return s_shadingCounters;
+        }
+
+        void Rasterizer::endShadingPass(const Tile& tile)
+        {
+            // Samples are tested in place of pixels while multisampling
+            FrameBuffer& target = m_multisampling ? *m_samples : m_frameBuffer;
+            const int samples = m_multisampling ? SAMPLE_COUNT : 1;
+
+            target.visitDepth([&target, &tile, samples](auto* depth)
+            {
+                for (int y = tile.top; y < tile.bottom; y++)
+                {
+                    auto* row = depth + static_cast<std::size_t>(y) * target.getWidth();
+
+                    for (int x = samples * tile.left; x < samples * tile.right; x++)
+                        row[x] = std::abs(row[x]);
+                }
+            });
+        }
+
+        void Rasterizer::setShadingMode(ShadingMode mode)
+        {
+            m_shadingMode = mode;
+
+            if (mode == ShadingMode::DEFERRED)
+                m_gBuffer.resize(static_cast<std::size_t>(m_width) * m_height);
+
+            if (mode == ShadingMode::VISIBILITY)
+                m_visibilityBuffer.resize(static_cast<std::size_t>(m_width) * m_height);
+        }
+
+        void Rasterizer::lightTile(const Tile& tile, const DeferredLighting& lighting)
+        {
+            expect(m_shadingMode == ShadingMode::DEFERRED);
+
+            for (int y = tile.top; y < tile.bottom; y++)
+            {
+                for (int x = tile.left; x < tile.right; x += SPAN_WIDTH)
+                {
+                    const int spanWidth = (std::min)(SPAN_WIDTH, tile.right - x);
+                    const std::size_t offset = static_cast<std::size_t>(y) * m_width + x;
+
+                    if (!m_profiling)
+                    {
+                        m_lightSpan(lighting, x, y, (1u << spanWidth) - 1, getDepth(offset), &m_gBuffer[offset], &m_data[offset]);
+                        continue;
+                    }
+
+                    const auto start = std::chrono::steady_clock::now();
+                    const unsigned lit = m_lightSpan(lighting, x, y, (1u << spanWidth) - 1, getDepth(offset), &m_gBuffer[offset], &m_data[offset]);
+                    s_shadingCounters.time += std::chrono::steady_clock::now() - start;
+                    s_shadingCounters.pixels += std::bitset<SPAN_WIDTH>(lit).count();
+                }
+            }
+        }
+
+        bool Rasterizer::testPixelDepth(std::size_t offset, double z)
+        {
+            return m_frameBuffer.visitDepth([offset, z](auto* depth)
+            {
+                using Encoding = DepthEncoding<std::decay_t<decltype(*depth)>>;
+                const auto encoded = Encoding::encode(z);
+
+                if (!Encoding::isInFront(encoded, depth[offset]))
+                    return false;
+
+                depth[offset] = encoded;
+                return true;
+            });
         }
 
         void Rasterizer::drawPixel(int x, int y, Color color)
@@ -65,14 +532,14 @@ namespace ModelViewer
             if (z <= 0)
                 return;
 
-            if (m_zBuffer[y * m_width + x] <= z)
+            if (!testPixelDepth(static_cast<std::size_t>(y) * m_width + x, z))
                 return;
 
-            m_zBuffer[y * m_width + x] = z;
             drawPixel(x, y, color);
         }
 
-        void Rasterizer::drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex)
+        void Rasterizer::drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex,
+            const Light::LightingState& lighting)
         {
             if (!checkPoint(x, y, m_width, m_height))
                 return;
@@ -80,22 +547,17 @@ namespace ModelViewer
             if (z <= 0)
                 return;
 
-            if (m_zBuffer[y * m_width + x] <= z)
-                return;
-
             // Update z-buffer
-            m_zBuffer[y * m_width + x] = z;
-
-            // TODO: calculate light
-
-            Light::Phong light({ { 99, 179, 219  }, 50 }, { Vector3<double>({ 0, 0, 1.0 }), { 145, 155, 237}, 50 });
+            if (!testPixelDepth(static_cast<std::size_t>(y) * m_width + x, z))
+                return;
 
-            color = light(normal, worldVertex, Vec3<double>({5.0, 0.0, 0.0}), color);
+            color = Light::Phong::shade(lighting, normal, worldVertex, color);
 
             drawPixel(x, y, color);
         }
 
-        void Rasterizer::drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex, double ks)
+        void Rasterizer::drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex, double ks,
+            const Light::LightingState& lighting)
         {
             if (!checkPoint(x, y, m_width, m_height))
                 return;
@@ -103,17 +565,11 @@ namespace ModelViewer
             if (z <= 0)
                 return;
 
-            if (m_zBuffer[y * m_width + x] <= z)
-                return;
-
             // Update z-buffer
-            m_zBuffer[y * m_width + x] = z;
-
-            // TODO: calculate light
-
-            Light::Phong light({ { 99, 179, 219  }, 50 }, { Vector3<double>({ 0, 0, 5.0 }), { 145, 155, 237}, 50 });
+            if (!testPixelDepth(static_cast<std::size_t>(y) * m_width + x, z))
+                return;
 
-            color = light(normal, worldVertex, Vec3<double>({ 5.0, 0.0, 0.0 }), color, ks);
+            color = Light::Phong::shade(lighting, normal, worldVertex, color, ks);
 
             drawPixel(x, y, color);
         }
@@ -329,7 +785,7 @@ namespace ModelViewer
 
         void Rasterizer::drawTriangle(Vec2<int> a, double zA, Vec3<double> aNormal, Vec3<double> aWorldVertex,
             Vec2<int> b, double zB, Vec3<double> bNormal, Vec3<double> bWorldVertex, 
-            Vec2<int> c, double zC, Vec3<double> cNormal, Vec3<double> cWorldVertex, Color color)
+            Vec2<int> c, double zC, Vec3<double> cNormal, Vec3<double> cWorldVertex, Color color, const Light::LightingState& lighting)
         {
             if (zA <= 0 && zB <= 0 && zC <= 0)
                 return;
@@ -368,7 +824,7 @@ namespace ModelViewer
             const Vec3<double> alphaNormalDistance = cNormal - aNormal;
             const Vec3<double> alphaWorldVertexDistance = static_cast<Vec3<double>>(cWorldVertex - aWorldVertex);
 
-            const auto drawBetaPartTriangle = [this](const Vec2<int>& a, double zA, const Vec3<double>& aNormal, const Vec3<double>& aWorldVertex,
+            const auto drawBetaPartTriangle = [this, &lighting](const Vec2<int>& a, double zA, const Vec3<double>& aNormal, const Vec3<double>& aWorldVertex,
                 const Vec2<int>& b, double zB, const Vec3<double>& bNormal, const Vec3<double>& bWorldVertex,
                 const Vec2<int>& zeroPoint, double zZeroPoint, const Vec3<double>& zeroPointNormal, const Vec3<double>& zeroPointWorldVertex,
                 double alphaZDistance, const Vec3<double>& alphaNormalDistance, const Vec3<double>& alphaWorldVertexDistance,
@@ -404,7 +860,7 @@ namespace ModelViewer
                     }
 
                     drawHorizontalLineUnsafe(static_cast<int>(alphaX - 1), alphaZ, alphaNormal, alphaWorldVertex,
-                        static_cast<int>(std::ceil(betaX + 2)), betaZ, betaNormal, betaWorldVertex, y, color);
+                        static_cast<int>(std::ceil(betaX + 2)), betaZ, betaNormal, betaWorldVertex, y, color, lighting);
                 }
             };
 
@@ -426,7 +882,8 @@ namespace ModelViewer
         void Rasterizer::drawTriangle(Vec2<int> a, double zA, Vec3<double> aWorldVertex, Vec3<double> uvA,
             Vec2<int> b, double zB, Vec3<double> bWorldVertex, Vec3<double> uvB,
             Vec2<int> c, double zC, Vec3<double> cWorldVertex, Vec3<double> uvC,
-            const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap)
+            const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap, std::uint32_t id,
+            const Matrix3<double>& normalMatrix, const Light::LightingState& lighting, const Tile& tile, DepthPass pass)
         {
             if (zA <= 0 && zB <= 0 && zC <= 0)
                 return;
@@ -475,12 +932,13 @@ namespace ModelViewer
             const Vec3<double> alphaUVDistance = uvC - uvA;
             const double alphaUVCorrectionDistance = cUVCorrection - aUVCorrection;
 
-            const auto drawBetaPartTriangle = [this](const Vec2<int>& a, double zA, const Vec3<double>& aWorldVertex, const Vec3<double>& uvA, double aUVCorrection,
+            const SpanShader shader = makeSpanShader(diffuseMap, normalMap, specularMap, id, normalMatrix, lighting, pass);
+
+            const auto drawBetaPartTriangle = [this, &tile, &shader, pass](const Vec2<int>& a, double zA, const Vec3<double>& aWorldVertex, const Vec3<double>& uvA, double aUVCorrection,
                 const Vec2<int>& b, double zB, const Vec3<double>& bWorldVertex, const Vec3<double>& uvB, double bUVCorrection,
                 const Vec2<int>& zeroPoint, double zZeroPoint, const Vec3<double>& zeroPointWorldVertex, const Vec3<double>& zeroPointUV, double zeroPointUVCorrection,
                 double alphaZDistance, const Vec3<double>& alphaWorldVertexDistance, const Vec3<double>& alphaUVDistance, double alphaUVCorrectionDistance,
-                int totalHeight, const Vec2<int>& alphaDistanceVec, 
-                const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap)
+                int totalHeight, const Vec2<int>& alphaDistanceVec)
             {
                 const int segmentHeight = b[Y] - a[Y] + 1;
                 const auto betaDistanceVec = b - a;
@@ -489,7 +947,11 @@ namespace ModelViewer
                 const auto betaWorldVertexDistance = bWorldVertex - aWorldVertex;
                 const auto betaUVCorrectionDistance = 1 / zB - 1 / zA;
 
-                for (int y = a[Y]; y <= b[Y]; y++)
+                // Only scanlines inside of the tile are owned by this call
+                const int minY = (std::max)(a[Y], tile.top);
+                const int maxY = (std::min)(b[Y], tile.bottom - 1);
+
+                for (int y = minY; y <= maxY; y++)
                 {
                     const double alpha = (static_cast<double>(y) - zeroPoint[Y]) / totalHeight;
                     const double beta = (static_cast<double>(y) - a[Y]) / segmentHeight; // Don't care zero division: always 1 or greater
@@ -517,7 +979,7 @@ namespace ModelViewer
 
                     drawHorizontalLineUnsafe(static_cast<int>(alphaX - 1), alphaZ, alphaWorldVertex, alphaUV / alphaUVCorrection,
                         static_cast<int>(std::ceil(betaX + 2)), betaZ, betaWorldVertex, betaUV / betaUVCorrection,
-                        y, diffuseMap, normalMap, specularMap);
+                        y, shader, tile, pass);
                 }
             };
 
@@ -526,16 +988,417 @@ namespace ModelViewer
                 b, zB, bWorldVertex, uvB, bUVCorrection,
                 a, zA, aWorldVertex, uvA, aUVCorrection,
                 alphaZDistance, alphaWorldVertexDistance, alphaUVDistance, alphaUVCorrectionDistance,
-                totalHeight, alphaDistanceVec, 
-                diffuseMap, normalMap, specularMap);
+                totalHeight, alphaDistanceVec);
 
             // Draw bottom beta part
             drawBetaPartTriangle(b, zB, bWorldVertex, uvB, bUVCorrection,
                 c, zC, cWorldVertex, uvC, cUVCorrection,
                 a, zA, aWorldVertex, uvA, aUVCorrection,
                 alphaZDistance, alphaWorldVertexDistance, alphaUVDistance, alphaUVCorrectionDistance,
-                totalHeight, alphaDistanceVec,
-                diffuseMap, normalMap, specularMap);
+                totalHeight, alphaDistanceVec);
+        }
+
+        void Rasterizer::drawTriangleHalfSpace(const Vec4<double>& a, const Vec3<double>& aWorldVertex, const Vec3<double>& uvA,
+            const Vec4<double>& b, const Vec3<double>& bWorldVertex, const Vec3<double>& uvB,
+            const Vec4<double>& c, const Vec3<double>& cWorldVertex, const Vec3<double>& uvC,
+            const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap, std::uint32_t id,
+            const Matrix3<double>& normalMatrix, const Light::LightingState& lighting, const Tile& tile, DepthPass pass)
+        {
+            if (a[Z] <= 0 || b[Z] <= 0 || c[Z] <= 0)
+                return;
+
+            for (const auto& vertex : { std::cref(a), std::cref(b), std::cref(c) })
+                if (std::abs(vertex.get()[X]) > GUARD_BAND || std::abs(vertex.get()[Y]) > GUARD_BAND)
+                    return;
+
+            const FixedTriangle triangle(a, b, c);
+
+            if (triangle.area == 0)
+                return;
+
+            const auto& [xs, ys, order, area] = triangle;
+            const std::array<EdgeFunction, 3> edges = triangle.getEdges();
+
+            // Bounding box clipped to the tile
+            const int minX = (std::max)(tile.left, static_cast<int>(*std::min_element(xs.begin(), xs.end()) >> SUBPIXEL_BITS));
+            const int minY = (std::max)(tile.top, static_cast<int>(*std::min_element(ys.begin(), ys.end()) >> SUBPIXEL_BITS));
+            const int maxX = (std::min)(tile.right - 1, static_cast<int>(*std::max_element(xs.begin(), xs.end()) >> SUBPIXEL_BITS));
+            const int maxY = (std::min)(tile.bottom - 1, static_cast<int>(*std::max_element(ys.begin(), ys.end()) >> SUBPIXEL_BITS));
+
+            if (minX > maxX || minY > maxY)
+                return;
+
+            const std::array<std::reference_wrapper<const Vec4<double>>, 3> inputVertices = { std::cref(a), std::cref(b), std::cref(c) };
+            const std::array<std::reference_wrapper<const Vec3<double>>, 3> inputWorldVertices = { std::cref(aWorldVertex), std::cref(bWorldVertex), std::cref(cWorldVertex) };
+            const std::array<std::reference_wrapper<const Vec3<double>>, 3> inputUVs = { std::cref(uvA), std::cref(uvB), std::cref(uvC) };
+            const auto vertex = [&triangle](const auto& values, int i) { return values[triangle.order[i]]; };
+
+            const double areaDouble = static_cast<double>(area);
+            const AttributePlane zPlane(vertex(inputVertices, 0).get()[Z], vertex(inputVertices, 1).get()[Z], vertex(inputVertices, 2).get()[Z],
+                edges, areaDouble);
+
+            // Edge values and depth at the samples relative to the pixel center. With one sample per pixel
+            // the offsets stay zero and coverage has a bit per pixel.
+            std::array<std::array<std::int64_t, SAMPLE_COUNT>, 3> sampleOffsets = {};
+            std::array<std::int64_t, 3> minSampleOffsets = {};
+            std::array<std::int64_t, 3> maxSampleOffsets = {};
+            std::array<double, SAMPLE_COUNT> zOffsets = {};
+            const bool isMultisampled = m_multisampling;
+
+            if (isMultisampled)
+            {
+                expect(m_shadingMode == ShadingMode::FORWARD);
+
+                for (int s = 0; s < SAMPLE_COUNT; s++)
+                {
+                    const int dx = SAMPLE_OFFSETS[s][X];
+                    const int dy = SAMPLE_OFFSETS[s][Y];
+
+                    for (int e = 0; e < 3; e++)
+                    {
+                        sampleOffsets[e][s] = edges[e].offset(dx, dy);
+                        minSampleOffsets[e] = (std::min)(minSampleOffsets[e], sampleOffsets[e][s]);
+                        maxSampleOffsets[e] = (std::max)(maxSampleOffsets[e], sampleOffsets[e][s]);
+                    }
+
+                    zOffsets[s] = (zPlane.stepX * dx + zPlane.stepY * dy) / SUBPIXEL_SCALE;
+                }
+            }
+
+            // Each row of a block is at most SPAN_WIDTH pixels wide and is drawn with one kernel call
+            static_assert(BLOCK_SIZE == SPAN_WIDTH);
+            static_assert(SAMPLE_COUNT * SPAN_WIDTH <= 32);
+
+            // Walk 8x8 blocks: blocks fully outside of any edge are skipped, blocks fully inside
+            // of all edges are filled without per-pixel coverage tests
+            const auto walkBlocks = [&](const auto& drawSpan)
+            {
+                for (int blockY = minY & ~(BLOCK_SIZE - 1); blockY <= maxY; blockY += BLOCK_SIZE)
+                {
+                    for (int blockX = minX & ~(BLOCK_SIZE - 1); blockX <= maxX; blockX += BLOCK_SIZE)
+                    {
+                        const int lastBlockX = blockX + BLOCK_SIZE - 1;
+                        const int lastBlockY = blockY + BLOCK_SIZE - 1;
+
+                        bool isRejected = false;
+                        bool isAccepted = true;
+
+                        for (int e = 0; e < 3; e++)
+                        {
+                            const EdgeFunction& edge = edges[e];
+                            const std::int64_t corners[] = {
+                                edge.at(blockX, blockY) + edge.bias,
+                                edge.at(lastBlockX, blockY) + edge.bias,
+                                edge.at(blockX, lastBlockY) + edge.bias,
+                                edge.at(lastBlockX, lastBlockY) + edge.bias
+                            };
+
+                            const auto [minCorner, maxCorner] = std::minmax_element(std::begin(corners), std::end(corners));
+
+                            if (*maxCorner + maxSampleOffsets[e] < 0)
+                            {
+                                isRejected = true;
+                                break;
+                            }
+
+                            if (*minCorner + minSampleOffsets[e] < 0)
+                                isAccepted = false;
+                        }
+
+                        if (isRejected)
+                            continue;
+
+                        const int firstX = (std::max)(blockX, minX);
+                        const int lastX = (std::min)(lastBlockX, maxX);
+                        const int firstY = (std::max)(blockY, minY);
+                        const int lastY = (std::min)(lastBlockY, maxY);
+
+                        const int spanWidth = lastX - firstX + 1;
+                        const unsigned fullCoverage = isMultisampled ? ~0u >> (32 - SAMPLE_COUNT * spanWidth) : (1u << spanWidth) - 1;
+
+                        for (int y = firstY; y <= lastY; y++)
+                        {
+                            unsigned coverage = fullCoverage;
+
+                            if (!isAccepted)
+                            {
+                                std::int64_t w0 = edges[0].at(firstX, y) + edges[0].bias;
+                                std::int64_t w1 = edges[1].at(firstX, y) + edges[1].bias;
+                                std::int64_t w2 = edges[2].at(firstX, y) + edges[2].bias;
+
+                                coverage = 0;
+
+                                for (int i = 0; i < spanWidth; i++)
+                                {
+                                    // Sign bit of the OR is set if any of the edge values is negative
+                                    if (!isMultisampled && (w0 | w1 | w2) >= 0)
+                                        coverage |= 1u << i;
+
+                                    for (int s = 0; isMultisampled && s < SAMPLE_COUNT; s++)
+                                    {
+                                        if (((w0 + sampleOffsets[0][s]) | (w1 + sampleOffsets[1][s]) | (w2 + sampleOffsets[2][s])) >= 0)
+                                            coverage |= 1u << (SAMPLE_COUNT * i + s);
+                                    }
+
+                                    w0 += edges[0].stepX;
+                                    w1 += edges[1].stepX;
+                                    w2 += edges[2].stepX;
+                                }
+                            }
+
+                            if (coverage)
+                                drawSpan(firstX, y, coverage);
+                        }
+                    }
+                }
+            };
+
+            if (pass == DepthPass::DEPTH_ONLY && isMultisampled)
+            {
+                walkBlocks([&](int x, int y, unsigned coverage)
+                {
+                    const std::size_t offset = static_cast<std::size_t>(y) * m_width + x;
+
+                    m_samples->visitDepth([&](auto* depth)
+                    {
+                        testSamples(SpanDepthTest::LESS, zPlane.at(x, y), zPlane.stepX, zOffsets, coverage, depth + SAMPLE_COUNT * offset);
+                    });
+                });
+
+                return;
+            }
+
+            if (pass == DepthPass::DEPTH_ONLY)
+            {
+                walkBlocks([&](int x, int y, unsigned coverage)
+                {
+                    m_depthSpan(zPlane.at(x, y), zPlane.stepX, coverage, getDepth(static_cast<std::size_t>(y) * m_width + x));
+                });
+
+                return;
+            }
+
+            // Only depth and the triangle are stored, attributes are reconstructed in resolveTile
+            if (m_shadingMode == ShadingMode::VISIBILITY)
+            {
+                const SpanDepthTest depthTest = pass == DepthPass::SHADING ? SpanDepthTest::EQUAL : SpanDepthTest::LESS;
+
+                walkBlocks([&](int x, int y, unsigned coverage)
+                {
+                    const std::size_t offset = static_cast<std::size_t>(y) * m_width + x;
+                    m_visibilitySpan(zPlane.at(x, y), zPlane.stepX, depthTest, id, coverage, getDepth(offset), &m_visibilityBuffer[offset]);
+                });
+
+                return;
+            }
+
+            const TrianglePlanes planes(edges, areaDouble,
+                { vertex(inputVertices, 0), vertex(inputVertices, 1), vertex(inputVertices, 2) },
+                { vertex(inputWorldVertices, 0), vertex(inputWorldVertices, 1), vertex(inputWorldVertices, 2) },
+                { vertex(inputUVs, 0), vertex(inputUVs, 1), vertex(inputUVs, 2) });
+
+            SpanShader shader = makeSpanShader(diffuseMap, normalMap, specularMap, id, normalMatrix, lighting, pass);
+
+            if (isMultisampled)
+            {
+                // Samples are tested before shading, the kernel shades whatever it is given
+                const SpanDepthTest depthTest = shader.depthTest;
+                shader.depthTest = SpanDepthTest::ALWAYS;
+
+                walkBlocks([&](int x, int y, unsigned coverage)
+                {
+                    shadeSamples(shader, depthTest, planes.at(x, y), zOffsets, coverage, static_cast<std::size_t>(y) * m_width + x);
+                });
+
+                return;
+            }
+
+            walkBlocks([&](int x, int y, unsigned coverage)
+            {
+                invokeShadeSpan(shader, planes.at(x, y), coverage, static_cast<std::size_t>(y) * m_width + x);
+            });
+        }
+
+        void Rasterizer::resolveTile(const Tile& tile, const Light::LightingState& lighting, const VisibleTriangleLookup& lookup)
+        {
+            expect(m_shadingMode == ShadingMode::VISIBILITY);
+
+            // Setups of resolved triangles, neighbouring pixels mostly see the same few triangles
+            struct ResolvedTriangle
+            {
+                std::uint32_t id;
+                TrianglePlanes planes;
+                SpanShader shader;
+                // Spans of the tile pass start at the block or at the bounding box of the triangle clipped
+                // to the tile, whichever is further right. Attributes are rounded to float at the span start,
+                // so the resolve starts there as well.
+                int minX;
+            };
+
+            constexpr std::size_t CACHE_SIZE = 64;
+            constexpr std::uint32_t EMPTY = (std::numeric_limits<std::uint32_t>::max)();
+
+            // Direct mapped by id: triangles that are close in the index buffer are close on the screen,
+            // and they never share an entry unless their ids are CACHE_SIZE or more apart
+            std::array<ResolvedTriangle, CACHE_SIZE> cache;
+            for (ResolvedTriangle& entry : cache)
+                entry.id = EMPTY;
+
+            const auto resolve = [&](std::uint32_t id) -> const ResolvedTriangle&
+            {
+                ResolvedTriangle& entry = cache[id % CACHE_SIZE];
+
+                if (entry.id == id)
+                    return entry;
+
+                const VisibleTriangle triangle = lookup(id);
+                const auto& [vertices, worldVertices, uvs, diffuseMap, normalMap, specularMap, normalMatrix] = triangle;
+                const FixedTriangle fixed(vertices[0], vertices[1], vertices[2]);
+                const auto vertex = [&fixed](const auto& values, int i) { return std::cref(values[fixed.order[i]]); };
+
+                entry.id = id;
+                entry.minX = tile.left;
+
+                if (fixed.area != 0)
+                {
+                    // As drawTriangleHalfSpace clips the bounding box
+                    entry.minX = (std::max)(tile.left, static_cast<int>(*std::min_element(fixed.xs.begin(), fixed.xs.end()) >> SUBPIXEL_BITS));
+                    entry.planes = TrianglePlanes(fixed.getEdges(), static_cast<double>(fixed.area),
+                        { vertex(vertices, 0), vertex(vertices, 1), vertex(vertices, 2) },
+                        { vertex(worldVertices, 0), vertex(worldVertices, 1), vertex(worldVertices, 2) },
+                        { vertex(uvs, 0), vertex(uvs, 1), vertex(uvs, 2) });
+                }
+                else
+                {
+                    // Only the scanline rasterizer covers pixels of degenerate triangles, the first vertex stands for them
+                    const double invZ = 1 / vertices[0][Z];
+
+                    entry.planes.z = AttributePlane(vertices[0][Z]);
+                    entry.planes.invZ = AttributePlane(invZ);
+                    entry.planes.u = AttributePlane(uvs[0][U] * invZ);
+                    entry.planes.v = AttributePlane(uvs[0][V] * invZ);
+                    entry.planes.worldX = AttributePlane(worldVertices[0][X] * invZ);
+                    entry.planes.worldY = AttributePlane(worldVertices[0][Y] * invZ);
+                    entry.planes.worldZ = AttributePlane(worldVertices[0][Z] * invZ);
+                }
+
+                entry.shader = makeSpanShader(*diffuseMap, *normalMap, *specularMap, id, *normalMatrix, lighting, DepthPass::SINGLE);
+                entry.shader.depthTest = SpanDepthTest::ALWAYS;
+
+                return entry;
+            };
+
+            for (int y = tile.top; y < tile.bottom; y++)
+            {
+                for (int x = tile.left; x < tile.right; x += SPAN_WIDTH)
+                {
+                    const int spanWidth = (std::min)(SPAN_WIDTH, tile.right - x);
+                    const std::size_t offset = static_cast<std::size_t>(y) * m_width + x;
+                    const std::uint32_t* const ids = &m_visibilityBuffer[offset];
+
+                    // Pixels whose depth is not cleared hold a surface
+                    unsigned remaining = m_frameBuffer.visitDepth([offset, spanWidth](const auto* depth)
+                    {
+                        unsigned surfaces = 0;
+                        for (int i = 0; i < spanWidth; i++)
+                            if (DepthEncoding<std::decay_t<decltype(*depth)>>::isSurface(depth[offset + i]))
+                                surfaces |= 1u << i;
+
+                        return surfaces;
+                    });
+
+                    // Pixels of one triangle are shaded with one kernel call
+                    while (remaining)
+                    {
+                        int first = 0;
+                        while (!(remaining & 1u << first))
+                            first++;
+
+                        const std::uint32_t id = ids[first];
+                        unsigned coverage = 0;
+
+                        for (int i = first; i < spanWidth; i++)
+                            if (remaining & 1u << i && ids[i] == id)
+                                coverage |= 1u << i;
+
+                        remaining &= ~coverage;
+
+                        const ResolvedTriangle& triangle = resolve(id);
+
+                        // Pixels of the half-space rasterizer are inside of the bounding box, so none of them is dropped.
+                        // Renderer never draws the visibility buffer with the scanline one, whose spans reach past it.
+                        const int spanX = (std::max)(x, triangle.minX);
+                        invokeShadeSpan(triangle.shader, triangle.planes.at(spanX, y), coverage >> (spanX - x), offset + (spanX - x));
+                    }
+                }
+            }
+        }
+
+        void Rasterizer::invokeShadeSpan(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, std::size_t offset)
+        {
+            void* const depth = getDepth(offset);
+
+            // Writing the G-buffer is a part of rasterization, shading is measured in lightTile
+            if (m_shadingMode == ShadingMode::DEFERRED)
+            {
+                m_gBufferSpan(shader, attributes, coverage, depth, &m_gBuffer[offset]);
+                return;
+            }
+
+            // Resolving passes the ALWAYS test, so it shades whatever the pass
+            if (m_shadingMode == ShadingMode::VISIBILITY && shader.depthTest != SpanDepthTest::ALWAYS)
+            {
+                m_visibilitySpan(attributes.z, attributes.zStepX, shader.depthTest, shader.material, coverage, depth, &m_visibilityBuffer[offset]);
+                return;
+            }
+
+            if (!m_profiling)
+            {
+                m_shadeSpan(shader, attributes, coverage, depth, &m_data[offset]);
+                return;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            const unsigned visible = m_shadeSpan(shader, attributes, coverage, depth, &m_data[offset]);
+            s_shadingCounters.time += std::chrono::steady_clock::now() - start;
+            s_shadingCounters.pixels += std::bitset<SPAN_WIDTH>(visible).count();
+        }
+
+        void Rasterizer::shadeSamples(const SpanShader& shader, SpanDepthTest depthTest, const SpanAttributes& attributes,
+            const std::array<double, SAMPLE_COUNT>& zOffsets, unsigned coverage, std::size_t offset)
+        {
+            const unsigned passed = m_samples->visitDepth([&](auto* depth)
+            {
+                return testSamples(depthTest, attributes.z, attributes.zStepX, zOffsets, coverage, depth + SAMPLE_COUNT * offset);
+            });
+
+            unsigned pixels = 0;
+            for (int i = 0; i < SPAN_WIDTH; i++)
+                if (passed >> (SAMPLE_COUNT * i) & ((1u << SAMPLE_COUNT) - 1))
+                    pixels |= 1u << i;
+
+            if (!pixels)
+                return;
+
+            unsigned colors[SPAN_WIDTH];
+
+            if (!m_profiling)
+            {
+                m_shadeSpan(shader, attributes, pixels, getDepth(offset), colors);
+            }
+            else
+            {
+                const auto start = std::chrono::steady_clock::now();
+                m_shadeSpan(shader, attributes, pixels, getDepth(offset), colors);
+                s_shadingCounters.time += std::chrono::steady_clock::now() - start;
+                s_shadingCounters.pixels += std::bitset<SPAN_WIDTH>(pixels).count();
+            }
+
+            unsigned* const sampleColors = m_samples->getColorData() + SAMPLE_COUNT * offset;
+
+            for (int sample = 0; sample < SAMPLE_COUNT * SPAN_WIDTH; sample++)
+                if (passed & 1u << sample)
+                    sampleColors[sample] = colors[sample / SAMPLE_COUNT];
         }
 
         void Rasterizer::drawQuadrangle(Vec3<double> a, Vec3<double> b, Vec3<double> c, Vec3<double> d, Color color)
@@ -579,7 +1442,8 @@ namespace ModelViewer
             } 
         }
         void Rasterizer::drawHorizontalLineUnsafe(int minX, double zMinX, Vec3<double> minXNormal, Vec3<double> minXWorldVertex,
-            int maxX, double zMaxX, Vec3<double> maxXNormal, Vec3<double> maxXWorldVertex, int y, Color color)
+            int maxX, double zMaxX, Vec3<double> maxXNormal, Vec3<double> maxXWorldVertex, int y, Color color,
+            const Light::LightingState& lighting)
         {
             const double xDistance = std::abs(maxX - minX);
 
@@ -593,7 +1457,7 @@ namespace ModelViewer
 
             for (int x = minX; x < maxX; x++)
             {
-                drawPixel(x, y, z, color, normal.normalize(), worldVertex);
+                drawPixel(x, y, z, color, normal.normalize(), worldVertex, lighting);
                 z += zGrowth;
                 normal += normalGrowth;
             }
@@ -601,23 +1465,46 @@ namespace ModelViewer
 
         void Rasterizer::drawHorizontalLineUnsafe(int minX, double zMinX, Vec3<double> minXWorldVertex, Vec3<double> minXUV, 
             int maxX, double zMaxX, Vec3<double> maxXWorldVertex, Vec3<double> maxXUV, int y,
-            const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap)
+            const SpanShader& shader, const Tile& tile, DepthPass pass)
         {
+            // Clip span to the tile, other tiles are drawn by other workers
+            const int firstX = (std::max)(minX, tile.left);
+            const int lastX = (std::min)(maxX, tile.right);
+
+            if (firstX >= lastX)
+                return;
+
             const double xDistance = std::abs(maxX - minX);
 
             const Vec3<double> uvGrowth = (maxXUV - minXUV) / xDistance;
             const Vec3<double> worldVertexGrowth = (maxXWorldVertex - minXWorldVertex) / xDistance;
             const double zGrowth = (zMaxX - zMinX) / xDistance;
 
-            double z = zMinX;
-            Vec3<double> uv = minXUV;
-            Vec3<double> worldVertex = minXWorldVertex;
-
-            for (int x = minX; x < maxX; x++)
+            // UV is already perspective correct at the ends of the span and is interpolated linearly in between
+            for (int x = firstX; x < lastX; x += SPAN_WIDTH)
             {
-                drawPixel(x, y, z, diffuseMap(uv[U], uv[V]), normalMap(uv[U], uv[V]), worldVertex, specularMap(uv[U], uv[V]));
-                z += zGrowth;
-                uv += uvGrowth;
+                const double skippedPixels = x - minX;
+                const int spanWidth = (std::min)(SPAN_WIDTH, lastX - x);
+                const std::size_t offset = static_cast<std::size_t>(y) * m_width + x;
+
+                if (pass == DepthPass::DEPTH_ONLY)
+                {
+                    m_depthSpan(zMinX + zGrowth * skippedPixels, zGrowth, (1u << spanWidth) - 1, getDepth(offset));
+                    continue;
+                }
+
+                const SpanAttributes attributes = {
+                    zMinX + zGrowth * skippedPixels,
+                    zGrowth,
+                    { 1, 0 },
+                    makeSpanValue(minXUV[U] + uvGrowth[U] * skippedPixels, uvGrowth[U]),
+                    makeSpanValue(minXUV[V] + uvGrowth[V] * skippedPixels, uvGrowth[V]),
+                    makeSpanValue(minXWorldVertex[X] + worldVertexGrowth[X] * skippedPixels, worldVertexGrowth[X]),
+                    makeSpanValue(minXWorldVertex[Y] + worldVertexGrowth[Y] * skippedPixels, worldVertexGrowth[Y]),
+                    makeSpanValue(minXWorldVertex[Z] + worldVertexGrowth[Z] * skippedPixels, worldVertexGrowth[Z])
+                };
+
+                invokeShadeSpan(shader, attributes, (1u << spanWidth) - 1, offset);
             }
         }
     }
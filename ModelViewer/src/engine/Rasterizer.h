@@ -1,10 +1,16 @@
 #pragma once
 #include "pch.h"
 #include "math/Vector.h"
+#include "math/Matrix.h"
 #include "engine/Color.h"
 #include "engine/DiffuseMap.h"
 #include "engine/NormalMap.h"
 #include "engine/SpecularMap.h"
+#include "engine/TileBinner.h"
+#include "engine/FrameBuffer.h"
+#include "engine/FrameStats.h"
+#include "engine/SpanKernel.h"
+#include "engine/light/LightingState.h"
 
 namespace ModelViewer
 {
@@ -15,16 +21,83 @@ namespace ModelViewer
             class Object;
         }
 
+        enum class RasterizationCore
+        {
+            SCANLINE,
+            HALF_SPACE
+        };
+
+        // With a depth pre-pass a tile is drawn twice: depth only, then shading only the fragments
+        // whose depth equals the final one, so every pixel is shaded once
+        enum class DepthPass
+        {
+            SINGLE,
+            DEPTH_ONLY,
+            SHADING
+        };
+
+        // Deferred shading rasterizes surfaces into a G-buffer, lightTile shades every visible pixel once afterwards.
+        // The visibility buffer keeps only depth and the triangle of a pixel, resolveTile reconstructs its attributes.
+        enum class ShadingMode
+        {
+            FORWARD,
+            DEFERRED,
+            VISIBILITY
+        };
+
+        // Triangle of the visibility buffer as it was drawn
+        struct VisibleTriangle
+        {
+            std::array<Vec4<double>, 3> vertices;
+            std::array<Vec3<double>, 3> worldVertices;
+            std::array<Vec3<double>, 3> uvs;
+            const DiffuseMap* diffuseMap;
+            const NormalMap* normalMap;
+            const SpecularMap* specularMap;
+            const Matrix3<double>* normalMatrix;
+        };
+
+        using VisibleTriangleLookup = std::function<VisibleTriangle(std::uint32_t id)>;
+
         class Rasterizer
         {
+        public:
+            static constexpr int SAMPLE_COUNT = 4;
+
         public:
             Rasterizer(int width, int height);
+            // Tiles are cleared as they are first drawn in the frame, see beginTile
             void begin();
-            void end(Gdiplus::Graphics& gfx);
+            // Clears the tiles drawn in the last frame but not in this one, the frame buffer then holds the image
+            void end();
+            // Clears the tile if it holds an earlier frame, called by the worker that draws the tile before drawing it
+            void beginTile(const Tile& tile);
+            // Whether beginTile was called for the tile in this frame, tiles that were not hold no surface
+            bool isTileDrawn(const Tile& tile) const;
+            // Span kernels measure their time and covered pixels, see getShadingCounters
+            void setProfiling(bool enabled);
+            static ShadingCounters getShadingCounters();
+            // Restores depth of the tile after its SHADING pass
+            void endShadingPass(const Tile& tile);
+            void setShadingMode(ShadingMode mode);
+            void setDepthFormat(DepthFormat format);
+            // 4x MSAA of drawTriangleHalfSpace in forward shading: coverage and depth are kept per sample, a pixel
+            // is shaded once per triangle. Nothing else may draw while it is enabled. Sample buffers are
+            // allocated with the first switch and kept.
+            void setMultisampling(bool enabled);
+            // Averages the samples of the tile into the frame buffer after it is drawn. Depth of a pixel becomes
+            // its farthest sample, so the depth pyramid stays conservative.
+            void resolveSamples(const Tile& tile);
+            // Lighting pass of deferred shading, after every triangle covering the tile is drawn
+            void lightTile(const Tile& tile, const DeferredLighting& lighting);
+            // Shading pass of the visibility buffer, after every triangle covering the tile is drawn
+            void resolveTile(const Tile& tile, const Light::LightingState& lighting, const VisibleTriangleLookup& lookup);
             void drawPixel(int x, int y, Color color);
             void drawPixel(int x, int y, double z, Color color);
-            void drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex);
-            void drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex, double ks);
+            void drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex,
+                const Light::LightingState& lighting);
+            void drawPixel(int x, int y, double z, Color color, const Vec3<double>& normal, const Vec3<double>& worldVertex, double ks,
+                const Light::LightingState& lighting);
             void drawLine(int x1, int y1, int x2, int y2, Color color);
             void drawLine(int x1, int y1, double z1, int x2, int y2, double z2, Color color);
             void drawHorizontalLine(Vec2<int>&& a, Vec2<int>&& b, Color&& color);
@@ -34,39 +107,98 @@ namespace ModelViewer
             void drawTriangle(Vec2<int> a, double zA, Vec3<double> aNormal, Vec3<double> aWorldVertex,
                 Vec2<int> b, double zB, Vec3<double> bNormal, Vec3<double> bWorldVertex,
                 Vec2<int> c, double zC, Vec3<double> cNormal, Vec3<double> cWorldVertex,
-                Color color);
+                Color color, const Light::LightingState& lighting);
+            // Id is the material indexing DeferredLighting::diffuseMaps in deferred shading and
+            // the triangle passed to VisibleTriangleLookup in the visibility buffer
             void drawTriangle(Vec2<int> a, double zA, Vec3<double> aWorldVertex, Vec3<double> uvA,
                 Vec2<int> b, double zB, Vec3<double> bWorldVertex, Vec3<double> uvB,
                 Vec2<int> c, double zC, Vec3<double> cWorldVertex, Vec3<double> uvC,
-                const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap);
+                const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap, std::uint32_t id,
+                const Matrix3<double>& normalMatrix, const Light::LightingState& lighting, const Tile& tile, DepthPass pass);
+            void drawTriangleHalfSpace(const Vec4<double>& a, const Vec3<double>& aWorldVertex, const Vec3<double>& uvA,
+                const Vec4<double>& b, const Vec3<double>& bWorldVertex, const Vec3<double>& uvB,
+                const Vec4<double>& c, const Vec3<double>& cWorldVertex, const Vec3<double>& uvC,
+                const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap, std::uint32_t id,
+                const Matrix3<double>& normalMatrix, const Light::LightingState& lighting, const Tile& tile, DepthPass pass);
             void drawQuadrangle(Vec3<double> a, Vec3<double> b, Vec3<double> c, Vec3<double> d, Color color);
-            inline UINT getWidth() const
+            inline int getWidth() const
             {
                 return m_width;
             }
-            inline UINT getHeight() const
+            inline int getHeight() const
             {
                 return m_height;
             }
+            inline const FrameBuffer& getFrameBuffer() const
+            {
+                return m_frameBuffer;
+            }
+
+        private:
+            enum class TileState : std::uint8_t
+            {
+                CLEARED,
+                // Holds a frame before this one
+                STALE,
+                DRAWN
+            };
 
         private:
+            inline void* getDepth(std::size_t offset)
+            {
+                return m_depthData + offset * m_depthSize;
+            }
+            inline std::size_t getTileIndex(const Tile& tile) const
+            {
+                return static_cast<std::size_t>(tile.top / TileBinner::TILE_SIZE) * m_countTilesX + tile.left / TileBinner::TILE_SIZE;
+            }
+            // Depth test of a pixel at offset, writes its depth when it passes
+            bool testPixelDepth(std::size_t offset, double z);
+            // Shades the span at offset in the frame buffer or writes it to the G-buffer or the visibility buffer
+            void invokeShadeSpan(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, std::size_t offset);
+            // Depth tests the samples of the span at offset, bit SAMPLE_COUNT * i + s of coverage is sample s of pixel i.
+            // Pixels with a passing sample are shaded once at their center, the color goes to the passing samples.
+            void shadeSamples(const SpanShader& shader, SpanDepthTest depthTest, const SpanAttributes& attributes,
+                const std::array<double, SAMPLE_COUNT>& zOffsets, unsigned coverage, std::size_t offset);
+            // Clears the frame buffer and the samples of the tile
+            void clearTile(const Tile& tile);
             void drawHorizontalLineUnsafe(const Vec2<int>& a, const Vec2<int>& b, Color color);
             void drawHorizontalLineUnsafe(int minX, int maxX, int y, Color color);
             void drawHorizontalLineUnsafe(const Vec2<int>& a, double zA, const Vec2<int>& b, double zB, Color color);
             void drawHorizontalLineUnsafe(int minX, double zMinX, int maxX, double zMaxX, int y, Color color);
             void drawHorizontalLineUnsafe(int minX, double zMinX, Vec3<double> minXNormal, Vec3<double> minXWorldVertex,
-                int maxX, double zMaxX, Vec3<double> maxXNormal, Vec3<double> maxXWorldVertex, int y, Color color);
+                int maxX, double zMaxX, Vec3<double> maxXNormal, Vec3<double> maxXWorldVertex, int y, Color color,
+                const Light::LightingState& lighting);
             void drawHorizontalLineUnsafe(int minX, double zMinX, Vec3<double> minXWorldVertex, Vec3<double> minXUV,
                 int maxX, double zMaxX, Vec3<double> maxXWorldVertex, Vec3<double> maxXUV, int y, 
-                const DiffuseMap& diffuseMap, const NormalMap& normalMap, const SpecularMap& specularMap);
+                const SpanShader& shader, const Tile& tile, DepthPass pass);
 
         private:
-            static constexpr int STRIDE = 4;
-
             int m_width;
             int m_height;
-            std::vector<unsigned> m_data;
-            std::vector<double> m_zBuffer;
+            FrameBuffer m_frameBuffer;
+            unsigned* m_data;
+            // Depth buffer of the frame buffer in its format
+            std::uint8_t* m_depthData;
+            std::size_t m_depthSize;
+            ShadeSpanKernel m_shadeSpan;
+            DepthSpanKernel m_depthSpan;
+            GBufferSpanKernel m_gBufferSpan;
+            LightSpanKernel m_lightSpan;
+            VisibilitySpanKernel m_visibilitySpan;
+            // Clear state of the screen tiles of TileBinner, so only tiles drawn in one of the last two frames are cleared
+            int m_countTilesX;
+            std::vector<TileState> m_tileStates;
+            ShadingMode m_shadingMode = ShadingMode::FORWARD;
+            // Allocated with the first switch to deferred shading, never cleared: texels of pixels
+            // without a surface are ignored
+            std::vector<GBufferTexel> m_gBuffer;
+            // Triangles of the pixels in the visibility buffer, allocated and kept as the G-buffer
+            std::vector<std::uint32_t> m_visibilityBuffer;
+            bool m_multisampling = false;
+            // Sample s of pixel (x, y) is pixel (SAMPLE_COUNT * x + s, y), depth is in the format of the frame buffer
+            std::optional<FrameBuffer> m_samples;
+            bool m_profiling = false;
         };
     }
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+#include "pch.h"
+#include "math/Vector.h"
+#include "math/Matrix.h"
+#include "engine/MeshCluster.h"
+
+namespace ModelViewer::Engine
+{
+    // Points origin + t * direction for t >= 0. Distances are measured in t, so they stay the same
+    // when the ray is transformed into another space.
+    struct Ray
+    {
+        Vec3<double> origin;
+        Vec3<double> direction;
+
+        Ray transform(const Matrix4<double>& matrix) const
+        {
+            const Vec4<double> transformedOrigin = matrix * origin;
+            const Vec4<double> transformedDirection = matrix * Vec4<double>({ direction[0], direction[1], direction[2], 0.0 });
+
+            return {
+                Vec3<double>({ transformedOrigin[0], transformedOrigin[1], transformedOrigin[2] }),
+                Vec3<double>({ transformedDirection[0], transformedDirection[1], transformedDirection[2] })
+            };
+        }
+
+        // Slab test against a box, inverseDirection is 1 / direction per axis
+        bool intersects(const BoundingBox& box, const Vec3<double>& inverseDirection, double maxDistance) const
+        {
+            double nearest = 0;
+            double farthest = maxDistance;
+
+            for (int i = 0; i < 3; i++)
+            {
+                const double a = (box.min[i] - origin[i]) * inverseDirection[i];
+                const double b = (box.max[i] - origin[i]) * inverseDirection[i];
+                nearest = (std::max)(nearest, (std::min)(a, b));
+                farthest = (std::min)(farthest, (std::max)(a, b));
+            }
+
+            return nearest <= farthest;
+        }
+
+        // Distance to the triangle or infinity, both sides of the triangle are hit.
+        // See Moller, Trumbore "Fast, Minimum Storage Ray/Triangle Intersection"
+        double intersect(const Vec3<double>& a, const Vec3<double>& b, const Vec3<double>& c) const
+        {
+            constexpr double MISS = std::numeric_limits<double>::infinity();
+
+            const Vec3<double> ab = b - a;
+            const Vec3<double> ac = c - a;
+            const Vec3<double> p = direction.crossProduct(ac);
+            const double determinant = ab.dotProduct(p);
+
+            if (std::abs(determinant) < 1e-12)
+                return MISS;
+
+            const double inverseDeterminant = 1 / determinant;
+            const Vec3<double> s = origin - a;
+            const double u = s.dotProduct(p) * inverseDeterminant;
+
+            if (u < 0 || u > 1)
+                return MISS;
+
+            const Vec3<double> q = s.crossProduct(ab);
+            const double v = direction.dotProduct(q) * inverseDeterminant;
+
+            if (v < 0 || u + v > 1)
+                return MISS;
+
+            const double t = ac.dotProduct(q) * inverseDeterminant;
+
+            return t >= 0 ? t : MISS;
+        }
+    };
+}
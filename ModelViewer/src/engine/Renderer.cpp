@@ -0,0 +1,491 @@
+#include "pch.h"
+#include "Renderer.h"
+#include "Core.h"
+#include "engine/Primitives.h"
+
+namespace ModelViewer::Engine
+{
+    Renderer::Renderer(int width, int height)
+        :
+        m_rasterizer(width, height),
+        m_binner(width, height),
+        m_depthPyramid(width, height),
+        // The rendering thread works in the pool too while it waits
+        m_pool((std::max)(1, static_cast<int>(std::thread::hardware_concurrency()) - 1), 0x1000),
+        m_tileTimings(m_binner.getTilesCount())
+    {
+    }
+
+    void Renderer::render(Scene::Scene& scene, Viewport& viewport)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        m_stats = {};
+
+        const auto transformStart = Clock::now();
+        auto&& [verticesRef, packetsRef, indicesCount, lighting, screenMatrix] = scene.render(viewport);
+        const TransformedVertices& vertices = verticesRef.get();
+        const VertexStreams& streams = vertices.getStreams();
+        const std::vector<Scene::DrawPacket>& packets = packetsRef.get();
+
+        m_stats.transform = Clock::now() - transformStart;
+        m_stats.trianglesSubmitted = indicesCount / 3;
+
+        // The visibility buffer is resolved with the planes of the half-space rasterizer, pixels of the
+        // scanline one reach past them and would never be shaded
+        const RasterizationCore rasterizationCore = m_shadingMode == ShadingMode::VISIBILITY
+            ? RasterizationCore::HALF_SPACE : m_rasterizationCore;
+
+        const auto drawTile = [&](std::size_t tileIndex, DepthPass pass)
+        {
+            const Tile tile = m_binner.getTile(tileIndex);
+
+            // Bins keep the submission order, so packets of the triangles only move forward
+            std::size_t packetIndex = 0;
+
+            for (const std::size_t indexSelector : m_binner.getTriangles(tileIndex))
+            {
+                while (indexSelector >= packets[packetIndex].firstIndex + packets[packetIndex].indexCount)
+                    packetIndex++;
+
+                const Scene::DrawPacket& packet = packets[packetIndex];
+                const Scene::Material& material = packet.material;
+                const std::size_t first = indexSelector - packet.firstIndex;
+
+                const VertexIndex aInd = packet.indices[first];
+                const VertexIndex bInd = packet.indices[first + 1];
+                const VertexIndex cInd = packet.indices[first + 2];
+
+                const Vec4<double> a = vertices.getScreenVertex(packet.firstVertex + aInd);
+                const Vec4<double> b = vertices.getScreenVertex(packet.firstVertex + bInd);
+                const Vec4<double> c = vertices.getScreenVertex(packet.firstVertex + cInd);
+
+                const Vec3<double> aWorld = vertices.getWorldVertex(packet.firstVertex + aInd);
+                const Vec3<double> bWorld = vertices.getWorldVertex(packet.firstVertex + bInd);
+                const Vec3<double> cWorld = vertices.getWorldVertex(packet.firstVertex + cInd);
+
+                // The visibility buffer identifies triangles by their index in the scene, deferred shading packets by theirs
+                const std::uint32_t id = static_cast<std::uint32_t>(m_shadingMode == ShadingMode::VISIBILITY ? indexSelector / 3 : packetIndex);
+
+                if (rasterizationCore == RasterizationCore::HALF_SPACE)
+                {
+                    m_rasterizer.drawTriangleHalfSpace(a, aWorld, packet.uvs[aInd], b, bWorld, packet.uvs[bInd], c, cWorld, packet.uvs[cInd],
+                        *material.diffuseMap, *material.normalMap, *material.specularMap, id,
+                        packet.normalMatrix, lighting, tile, pass);
+                }
+                else
+                {
+                    m_rasterizer.drawTriangle(a, a[Z], aWorld, packet.uvs[aInd], b, b[Z], bWorld, packet.uvs[bInd], c, c[Z], cWorld, packet.uvs[cInd],
+                        *material.diffuseMap, *material.normalMap, *material.specularMap, id,
+                        packet.normalMatrix, lighting, tile, pass);
+                }
+            }
+        };
+
+        // Samples are drawn only by the half-space rasterizer and shaded in the tile pass
+        const bool multisampling = m_multisampling && rasterizationCore == RasterizationCore::HALF_SPACE
+            && m_shadingMode == ShadingMode::FORWARD;
+        m_rasterizer.setMultisampling(multisampling);
+
+        const auto clearStart = Clock::now();
+        m_rasterizer.begin();
+        m_stats.clear = Clock::now() - clearStart;
+
+        const auto& camera = scene.getActiveCamera();
+        const auto cameraVector = static_cast<Vector3<int>>(camera->getPosition() - camera->getTarget());
+
+        // Culls triangles of a cluster and sorts them into screen tiles
+        const auto binCluster = [&](const Scene::DrawPacket& packet, const MeshCluster& cluster, const DepthPyramid* depth)
+        {
+            const float* const screenZ = streams.screenZ + packet.firstVertex;
+
+            for (std::size_t i = 3 * std::size_t(cluster.firstTriangle); i < 3 * (std::size_t(cluster.firstTriangle) + cluster.trianglesCount); i += 3)
+            {
+                const VertexIndex aInd = packet.indices[i];
+                const VertexIndex bInd = packet.indices[i + 1];
+                const VertexIndex cInd = packet.indices[i + 2];
+
+                if (screenZ[aInd] <= 0 || screenZ[bInd] <= 0 || screenZ[cInd] <= 0)
+                    continue;
+
+                const Vec4<double> a = vertices.getScreenVertex(packet.firstVertex + aInd);
+                const Vec4<double> b = vertices.getScreenVertex(packet.firstVertex + bInd);
+                const Vec4<double> c = vertices.getScreenVertex(packet.firstVertex + cInd);
+
+                if (!Primitives::isTriangleTowardsCamera(cameraVector, { std::cref(a), std::cref(b), std::cref(c) }))
+                    continue;
+
+                m_stats.trianglesRasterized++;
+
+                auto [minX, maxX] = std::minmax({ a[X], b[X], c[X] });
+                auto [minY, maxY] = std::minmax({ a[Y], b[Y], c[Y] });
+
+                // Scanline rasterizer widens spans by 1 pixel to the left and 2 pixels to the right
+                if (rasterizationCore == RasterizationCore::SCANLINE)
+                {
+                    minX -= 1;
+                    maxX += 2;
+                }
+
+                if (depth)
+                    m_binner.binTriangle(packet.firstIndex + i, minX, minY, maxX, maxY, (std::min)({ a[Z], b[Z], c[Z] }), *depth);
+                else
+                    m_binner.binTriangle(packet.firstIndex + i, minX, minY, maxX, maxY);
+            }
+        };
+
+        // Screen rectangle and the nearest depth of an object space box against the depth pyramid
+        const auto isBoxOccluded = [&](const Scene::DrawPacket& packet, const BoundingBox& bounds)
+        {
+            constexpr double MAX = (std::numeric_limits<double>::max)();
+            double minX = MAX, minY = MAX, minZ = MAX;
+            double maxX = -MAX, maxY = -MAX;
+
+            for (int corner = 0; corner < 8; corner++)
+            {
+                const Vec4<double> point = packet.screenMatrix * Vec4<double>({
+                    (corner & 1 ? bounds.max : bounds.min)[X],
+                    (corner & 2 ? bounds.max : bounds.min)[Y],
+                    (corner & 4 ? bounds.max : bounds.min)[Z],
+                    1.0
+                });
+
+                // A box crossing the camera plane covers an unbounded part of the screen
+                if (point[W] <= 0 || point[Z] <= 0)
+                    return false;
+
+                minX = (std::min)(minX, point[X] / point[W]);
+                maxX = (std::max)(maxX, point[X] / point[W]);
+                minY = (std::min)(minY, point[Y] / point[W]);
+                maxY = (std::max)(maxY, point[Y] / point[W]);
+                minZ = (std::min)(minZ, point[Z]);
+            }
+
+            // Vertices are transformed in single precision, rectangle and depth get a margin for the rounding
+            // and the widened spans of the scanline rasterizer
+            return m_depthPyramid.isOccluded(minX - 2, minY - 2, maxX + 2, maxY + 2, minZ * (1 - 1e-5));
+        };
+
+        const auto rasterizeTiles = [&](bool updateDepthPyramid)
+        {
+            // Every tile is rasterized by exactly one worker, so color and depth writes never race
+            m_pool.parallelFor(0, m_binner.getTilesCount(), 1, [&](std::size_t firstTile, std::size_t lastTile)
+            {
+                for (std::size_t tileIndex = firstTile; tileIndex < lastTile; tileIndex++)
+                {
+                    if (m_binner.getTriangles(tileIndex).empty())
+                    {
+                        if (updateDepthPyramid)
+                            m_depthPyramid.clearTile(m_binner.getTile(tileIndex));
+
+                        continue;
+                    }
+
+                    const auto drawAndUpdateTile = [&]()
+                    {
+                        m_rasterizer.beginTile(m_binner.getTile(tileIndex));
+
+                        if (m_depthPrePass)
+                        {
+                            // Both passes run back to back while the tile is in the cache of this worker
+                            drawTile(tileIndex, DepthPass::DEPTH_ONLY);
+                            drawTile(tileIndex, DepthPass::SHADING);
+                            m_rasterizer.endShadingPass(m_binner.getTile(tileIndex));
+                        }
+                        else
+                        {
+                            drawTile(tileIndex, DepthPass::SINGLE);
+                        }
+
+                        if (multisampling)
+                            m_rasterizer.resolveSamples(m_binner.getTile(tileIndex));
+
+                        // The depth of the tile is still in the cache of this worker
+                        if (updateDepthPyramid)
+                            m_depthPyramid.updateTile(m_rasterizer.getFrameBuffer(), m_binner.getTile(tileIndex));
+                    };
+
+                    if (!m_profiling)
+                    {
+                        drawAndUpdateTile();
+                        continue;
+                    }
+
+                    // Tasks never move between threads, so thread local counters cover exactly this tile
+                    const ShadingCounters shadingBefore = Rasterizer::getShadingCounters();
+                    const auto tileStart = Clock::now();
+
+                    drawAndUpdateTile();
+
+                    const ShadingCounters shadingAfter = Rasterizer::getShadingCounters();
+                    TileTiming& timing = m_tileTimings[tileIndex];
+                    timing.total += Clock::now() - tileStart;
+                    timing.shading.time += shadingAfter.time - shadingBefore.time;
+                    timing.shading.pixels += shadingAfter.pixels - shadingBefore.pixels;
+                }
+            });
+        };
+
+        if (m_profiling)
+            std::fill(m_tileTimings.begin(), m_tileTimings.end(), TileTiming{});
+
+        // Occlusion of the clusters in the last frame by packet and cluster. It is only a guess of what is
+        // visible: a wrong guess after the scene changed costs time, never a missing triangle.
+        m_occludedClusters.resize(packets.size());
+        for (std::size_t i = 0; i < packets.size(); i++)
+            m_occludedClusters[i].resize(packets[i].clusters.size(), 0);
+
+        // The first pass draws clusters that were visible in the last frame. The depth pyramid built
+        // from them culls the rest of the clusters and their triangles in the second pass.
+        const auto cullingStart = Clock::now();
+        m_binner.begin();
+
+        for (std::size_t i = 0; i < packets.size(); i++)
+        {
+            for (const std::uint32_t clusterIndex : packets[i].visibleClusters)
+            {
+                const MeshCluster& cluster = packets[i].clusters[clusterIndex];
+                m_stats.trianglesInFrustum += cluster.trianglesCount;
+
+                if (!m_occlusionCulling || !m_occludedClusters[i][clusterIndex])
+                    binCluster(packets[i], cluster, nullptr);
+            }
+        }
+
+        m_stats.culling = Clock::now() - cullingStart;
+
+        const auto rasterizationStart = Clock::now();
+
+        rasterizeTiles(m_occlusionCulling);
+
+        StageDuration tilePass = Clock::now() - rasterizationStart;
+
+        if (m_occlusionCulling)
+        {
+            const auto occlusionStart = Clock::now();
+            m_depthPyramid.buildLevels();
+            m_binner.begin();
+
+            for (std::size_t i = 0; i < packets.size(); i++)
+            {
+                const Scene::DrawPacket& packet = packets[i];
+
+                if (packet.visibleClusters.empty())
+                    continue;
+
+                // Occluded nodes of the cluster tree drop their whole subtree, visible clusters of the rest are tested on their own
+                m_clusterOcclusion.resize(packet.clusters.size());
+                packet.clusterTree->cull([&](const BoundingBox& bounds) { return isBoxOccluded(packet, bounds); },
+                    [&](std::uint32_t clusterIndex, bool culled) { m_clusterOcclusion[clusterIndex] = culled; });
+
+                for (const std::uint32_t clusterIndex : packet.visibleClusters)
+                {
+                    const MeshCluster& cluster = packet.clusters[clusterIndex];
+                    const bool isDrawn = !m_occludedClusters[i][clusterIndex];
+                    const bool isOccluded = m_clusterOcclusion[clusterIndex] || isBoxOccluded(packet, cluster.bounds);
+
+                    m_occludedClusters[i][clusterIndex] = isOccluded;
+
+                    if (isDrawn)
+                        continue;
+
+                    if (isOccluded)
+                        m_stats.trianglesOccluded += cluster.trianglesCount;
+                    else
+                        binCluster(packet, cluster, &m_depthPyramid);
+                }
+            }
+
+            m_stats.culling += Clock::now() - occlusionStart;
+
+            const auto secondPassStart = Clock::now();
+            rasterizeTiles(false);
+            tilePass += Clock::now() - secondPassStart;
+        }
+
+        // Every pixel is shaded once, however many triangles were drawn over it
+        const auto resolveTiles = [&](const auto& resolveTile)
+        {
+            m_pool.parallelFor(0, m_binner.getTilesCount(), 1, [&](std::size_t firstTile, std::size_t lastTile)
+            {
+                for (std::size_t tileIndex = firstTile; tileIndex < lastTile; tileIndex++)
+                {
+                    const Tile tile = m_binner.getTile(tileIndex);
+
+                    // Nothing was drawn into the tile and it is cleared at the end of the frame
+                    if (!m_rasterizer.isTileDrawn(tile))
+                        continue;
+
+                    const ShadingCounters shadingBefore = Rasterizer::getShadingCounters();
+
+                    resolveTile(tile);
+
+                    if (m_profiling)
+                        m_tileTimings[tileIndex].shading.pixels += Rasterizer::getShadingCounters().pixels - shadingBefore.pixels;
+                }
+            });
+        };
+
+        StageDuration resolvePass = {};
+        const auto resolveStart = Clock::now();
+
+        if (m_shadingMode == ShadingMode::DEFERRED)
+        {
+            // Materials of packets out of the view are never set and never written to the G-buffer.
+            // The G-buffer keeps the packet index in 24 bits above the specular coefficient.
+            expect(packets.size() <= std::size_t(1) << 24);
+            m_materialMaps.assign(packets.size(), {});
+            for (std::size_t i = 0; i < packets.size(); i++)
+            {
+                if (packets[i].visibleClusters.empty())
+                    continue;
+
+                const DiffuseMap& diffuseMap = *packets[i].material.diffuseMap;
+                m_materialMaps[i] = { reinterpret_cast<const std::uint8_t*>(diffuseMap.data.data()),
+                    static_cast<std::int32_t>(diffuseMap.width), static_cast<std::int32_t>(diffuseMap.height) };
+            }
+
+            DeferredLighting deferred = { m_materialMaps.data(), {}, lighting.span };
+
+            // Screen depth and w are proportional with the near plane at 0, so the screen matrix has no
+            // inverse. Its x, y and w rows have one: it takes (x * w, y * w, w, 1) to the world position,
+            // the depth row then gives w of a depth. Matrices are indexed as (column, row).
+            Matrix4<double> screenXYW;
+            for (int column = 0; column < 4; column++)
+            {
+                screenXYW(column, 0) = screenMatrix(column, 0);
+                screenXYW(column, 1) = screenMatrix(column, 1);
+                screenXYW(column, 2) = screenMatrix(column, 3);
+                screenXYW(column, 3) = column == 3 ? 1 : 0;
+            }
+
+            const Matrix4<double> worldFromXYW = screenXYW.inverse();
+
+            for (int column = 0; column < 4; column++)
+            {
+                for (int row = 0; row < 3; row++)
+                    deferred.screenToWorld[row][column] = worldFromXYW(column, row);
+
+                double depth = 0;
+                for (int i = 0; i < 4; i++)
+                    depth += screenMatrix(i, 2) * worldFromXYW(column, i);
+
+                deferred.screenToWorld[3][column] = depth;
+            }
+
+            resolveTiles([&](const Tile& tile) { m_rasterizer.lightTile(tile, deferred); });
+            resolvePass = Clock::now() - resolveStart;
+        }
+        else if (m_shadingMode == ShadingMode::VISIBILITY)
+        {
+            // Attributes come from the vertex data of the frame, as drawTile passes them to the rasterizer
+            const auto lookup = [&](std::uint32_t id)
+            {
+                const std::size_t indexSelector = 3 * static_cast<std::size_t>(id);
+                const Scene::DrawPacket& packet = *(std::upper_bound(packets.begin(), packets.end(), indexSelector,
+                    [](std::size_t index, const Scene::DrawPacket& packet) { return index < packet.firstIndex; }) - 1);
+                const Scene::Material& material = packet.material;
+                const std::size_t first = indexSelector - packet.firstIndex;
+
+                VisibleTriangle triangle = {};
+                for (int i = 0; i < 3; i++)
+                {
+                    const VertexIndex index = packet.indices[first + i];
+                    triangle.vertices[i] = vertices.getScreenVertex(packet.firstVertex + index);
+                    triangle.worldVertices[i] = vertices.getWorldVertex(packet.firstVertex + index);
+                    triangle.uvs[i] = packet.uvs[index];
+                }
+
+                triangle.diffuseMap = material.diffuseMap;
+                triangle.normalMap = material.normalMap;
+                triangle.specularMap = material.specularMap;
+                triangle.normalMatrix = &packet.normalMatrix;
+
+                return triangle;
+            };
+
+            const VisibleTriangleLookup visibleTriangle = lookup;
+            resolveTiles([&](const Tile& tile) { m_rasterizer.resolveTile(tile, lighting, visibleTriangle); });
+            resolvePass = Clock::now() - resolveStart;
+        }
+
+        const auto endStart = Clock::now();
+        m_rasterizer.end();
+        m_stats.clear += Clock::now() - endStart;
+
+        m_stats.rasterization = tilePass;
+        m_stats.shading = resolvePass;
+
+        if (m_profiling)
+        {
+            Clock::duration totalTime = {};
+            Clock::duration shadingTime = {};
+
+            for (const TileTiming& timing : m_tileTimings)
+            {
+                totalTime += timing.total;
+                shadingTime += timing.shading.time;
+                m_stats.pixelsShaded += timing.shading.pixels;
+            }
+
+            // Deferred shading and the visibility buffer never shade in the tile pass
+            if (totalTime.count() > 0 && m_shadingMode == ShadingMode::FORWARD)
+            {
+                m_stats.shading = tilePass * (static_cast<double>(shadingTime.count()) / totalTime.count());
+                m_stats.rasterization = tilePass - m_stats.shading;
+            }
+        }
+    }
+
+    const FrameBuffer& Renderer::getFrameBuffer() const
+    {
+        return m_rasterizer.getFrameBuffer();
+    }
+
+    void Renderer::setRasterizationCore(RasterizationCore core)
+    {
+        m_rasterizationCore = core;
+    }
+
+    void Renderer::setOcclusionCulling(bool enabled)
+    {
+        m_occlusionCulling = enabled;
+    }
+
+    void Renderer::setDepthPrePass(bool enabled)
+    {
+        m_depthPrePass = enabled;
+    }
+
+    void Renderer::setShadingMode(ShadingMode mode)
+    {
+        m_shadingMode = mode;
+        m_rasterizer.setShadingMode(mode);
+    }
+
+    void Renderer::setDepthFormat(DepthFormat format)
+    {
+        m_rasterizer.setDepthFormat(format);
+    }
+
+    void Renderer::setMultisampling(bool enabled)
+    {
+        m_multisampling = enabled;
+    }
+
+    void Renderer::setProfiling(bool enabled)
+    {
+        m_profiling = enabled;
+        m_rasterizer.setProfiling(enabled);
+    }
+
+    const FrameStats& Renderer::getFrameStats() const
+    {
+        return m_stats;
+    }
+
+    ThreadPool& Renderer::getThreadPool()
+    {
+        return m_pool;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "pch.h"
+#include "ThreadPool.h"
+#include "engine/Viewport.h"
+#include "engine/Rasterizer.h"
+#include "engine/TileBinner.h"
+#include "engine/DepthPyramid.h"
+#include "engine/FrameBuffer.h"
+#include "engine/FrameStats.h"
+#include "engine/scene/Scene.h"
+
+namespace ModelViewer::Engine
+{
+    // Draws a scene into an offscreen frame buffer, independent of the window system
+    class Renderer
+    {
+    public:
+        Renderer(int width, int height);
+        void render(Scene::Scene& scene, Viewport& viewport);
+        const FrameBuffer& getFrameBuffer() const;
+        // Visibility buffer shading always uses the half-space rasterizer
+        void setRasterizationCore(RasterizationCore core);
+        // Culls clusters and triangles hidden behind the depth of clusters visible in the last frame
+        void setOcclusionCulling(bool enabled);
+        // Lays down depth of a tile before shading it, so hidden fragments are never shaded.
+        // Pays off with high overdraw, may be switched between frames.
+        void setDepthPrePass(bool enabled);
+        void setShadingMode(ShadingMode mode);
+        // Reversed float depth halves depth traffic, takes effect with the next frame
+        void setDepthFormat(DepthFormat format);
+        // 4x MSAA, used by forward shading with the half-space rasterizer
+        void setMultisampling(bool enabled);
+        // Measures rasterization and shading separately at the cost of timing every span
+        void setProfiling(bool enabled);
+        const FrameStats& getFrameStats() const;
+        // Usable for other work between frames from the thread that created the renderer
+        ThreadPool& getThreadPool();
+
+    private:
+        // Worker time spent on one tile, written only by the worker that draws the tile
+        struct TileTiming
+        {
+            std::chrono::steady_clock::duration total;
+            ShadingCounters shading;
+        };
+
+    private:
+        Rasterizer m_rasterizer;
+        TileBinner m_binner;
+        DepthPyramid m_depthPyramid;
+        RasterizationCore m_rasterizationCore = RasterizationCore::HALF_SPACE;
+        ThreadPool m_pool;
+        bool m_occlusionCulling = true;
+        bool m_depthPrePass = false;
+        ShadingMode m_shadingMode = ShadingMode::FORWARD;
+        bool m_multisampling = false;
+        bool m_profiling = false;
+        FrameStats m_stats = {};
+        std::vector<TileTiming> m_tileTimings;
+        std::vector<std::vector<std::uint8_t>> m_occludedClusters;
+        // Occlusion of the clusters of one packet against the depth pyramid of this frame
+        std::vector<std::uint8_t> m_clusterOcclusion;
+        // Diffuse maps of the packets, materials of deferred shading are packet indices
+        std::vector<SpanTexture<std::uint8_t>> m_materialMaps;
+    };
+}
@@ -0,0 +1,437 @@
+#include "pch.h"
+#include "SpanKernel.h"
+#include "engine/Color.h"
+#include "engine/FrameBuffer.h"
+#include "math/Vector.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPAN_KERNEL_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace ModelViewer::Engine
+{
+    // Kernels read the maps through raw pointers
+    static_assert(sizeof(Color) == 3);
+    static_assert(sizeof(Vec3<double>) == 3 * sizeof(double));
+
+    namespace
+    {
+        // Rows are stored bottom up, so v = 1 with u > 0 would land before the first texel
+        std::int32_t texelIndex(std::int32_t width, std::int32_t height, float u, float v)
+        {
+            const std::int32_t i = width * height
+                - (static_cast<std::int32_t>(v * height) * width + static_cast<std::int32_t>(u * width));
+            return (std::max)((std::min)(i, width * height - 1), 0);
+        }
+
+        float clampUnit(float value)
+        {
+            // NaN turns into 0 the same way as in _mm256_max_ps
+            return (std::min)((std::max)(0.0f, value), 1.0f);
+        }
+
+        // Passing pixels of a span, with the EQUAL test their depth is written negated
+        template<typename TDepth>
+        unsigned testDepth(SpanDepthTest depthTest, double spanZ, double zStepX, unsigned coverage, void* spanDepth)
+        {
+            using Encoding = DepthEncoding<TDepth>;
+
+            if (depthTest == SpanDepthTest::ALWAYS)
+                return coverage;
+
+            TDepth* const depth = static_cast<TDepth*>(spanDepth);
+            const bool isEqualTest = depthTest == SpanDepthTest::EQUAL;
+            unsigned visible = 0;
+
+            for (int i = 0; i < SPAN_WIDTH; i++)
+            {
+                if (!(coverage & 1u << i))
+                    continue;
+
+                const double z = spanZ + zStepX * i;
+
+                if (z <= 0)
+                    continue;
+
+                const TDepth encoded = Encoding::encode(z);
+
+                if (isEqualTest ? depth[i] != encoded : !Encoding::isInFront(encoded, depth[i]))
+                    continue;
+
+                depth[i] = isEqualTest ? -encoded : encoded;
+                visible |= 1u << i;
+            }
+
+            return visible;
+        }
+
+        // Perspective correct attributes and map texels of pixel i of a span
+        struct Surface
+        {
+            float u;
+            float v;
+            float world[3];
+            float normal[3];    // World space, not normalized
+            float ks;
+        };
+
+        Surface fetchSurface(const SpanShader& shader, const SpanAttributes& attributes, int i)
+        {
+            const auto at = [i](const SpanValue& attribute) { return attribute.value + attribute.stepX * i; };
+
+            Surface surface;
+
+            const float w = 1 / at(attributes.invZ);
+            surface.u = clampUnit(at(attributes.u) * w);
+            surface.v = clampUnit(at(attributes.v) * w);
+            surface.world[0] = at(attributes.worldX) * w;
+            surface.world[1] = at(attributes.worldY) * w;
+            surface.world[2] = at(attributes.worldZ) * w;
+
+            const double* normalTexel = shader.normalMap.texels
+                + 3 * texelIndex(shader.normalMap.width, shader.normalMap.height, surface.u, surface.v);
+            surface.ks = static_cast<float>(shader.specularMap.texels[texelIndex(shader.specularMap.width, shader.specularMap.height, surface.u, surface.v)]);
+
+            for (int c = 0; c < 3; c++)
+            {
+                const float* row = shader.normalMatrix[c];
+                surface.normal[c] = row[0] * static_cast<float>(normalTexel[0]) + row[1] * static_cast<float>(normalTexel[1])
+                    + row[2] * static_cast<float>(normalTexel[2]);
+            }
+
+            return surface;
+        }
+
+        // Phong with shininess of 4, returns the pixel as 0x00RRGGBB
+        unsigned shade(const SpanLighting& lighting, const float(&normal)[3], const float(&world)[3], float ks, const std::uint8_t* diffuse)
+        {
+            const float* light = lighting.lightDirection;
+
+            const float normalDotLight = normal[0] * light[0] + normal[1] * light[1] + normal[2] * light[2];
+            const float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            const float cosTheta = (std::max)(0.0f, normalDotLight / normalLength);
+
+            float specularFactor = 0;
+
+            if (cosTheta > 0)
+            {
+                float reflection[3];
+                float view[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    reflection[c] = light[c] - normal[c] * normalDotLight * 2;
+                    view[c] = lighting.viewPosition[c] - world[c];
+                }
+
+                const float reflectionLength = std::sqrt(reflection[0] * reflection[0] + reflection[1] * reflection[1] + reflection[2] * reflection[2]);
+                const float viewLength = std::sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+                const float cosAlpha = (std::max)(0.0f, (reflection[0] * view[0] + reflection[1] * view[1] + reflection[2] * view[2])
+                    / (reflectionLength * viewLength));
+
+                const float cosAlphaSquared = cosAlpha * cosAlpha;
+                specularFactor = cosAlphaSquared * cosAlphaSquared * ks;
+            }
+
+            unsigned channels[3];
+            for (int c = 0; c < 3; c++)
+            {
+                const float intensity = lighting.ambient[c] + lighting.diffuse[c] * cosTheta + lighting.specular[c] * specularFactor;
+                channels[c] = static_cast<unsigned>((std::min)((std::max)(0.0f, intensity * diffuse[c]), static_cast<float>(Color::MAX)));
+            }
+
+            return channels[0] << 16 | channels[1] << 8 | channels[2];
+        }
+
+        // Rounds to nearest even as _mm256_cvtps_epi32 does
+        std::uint32_t toUnorm(float value, std::uint32_t max)
+        {
+            return static_cast<std::uint32_t>(std::nearbyint(clampUnit(value) * max));
+        }
+
+        float fromUnorm(std::uint32_t value, std::uint32_t max)
+        {
+            return static_cast<float>(value) / static_cast<float>(max);
+        }
+
+        std::uint32_t toSnorm16(float value)
+        {
+            return static_cast<std::uint16_t>(static_cast<std::int32_t>(std::nearbyint((std::min)((std::max)(-1.0f, value), 1.0f) * 32767)));
+        }
+
+        // Octahedral encoding: the unit sphere is projected on the octahedron |x| + |y| + |z| = 1, whose
+        // lower half is folded over the upper one. Zero normals turn into +Z.
+        std::uint32_t encodeNormal(const float(&normal)[3])
+        {
+            const float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+
+            if (!(length > 0))
+                return 0;
+
+            float x = normal[0] / length;
+            float y = normal[1] / length;
+
+            if (normal[2] < 0)
+            {
+                const float foldedX = (1 - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+                y = (1 - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+                x = foldedX;
+            }
+
+            return toSnorm16(x) | toSnorm16(y) << 16;
+        }
+
+        void decodeNormal(std::uint32_t packed, float(&normal)[3])
+        {
+            float x = static_cast<std::int16_t>(packed & 0xFFFF) / 32767.0f;
+            float y = static_cast<std::int16_t>(packed >> 16) / 32767.0f;
+            const float z = 1 - std::abs(x) - std::abs(y);
+
+            // Unfold the lower half
+            const float fold = (std::max)(-z, 0.0f);
+            x += x >= 0 ? -fold : fold;
+            y += y >= 0 ? -fold : fold;
+
+            const float length = std::sqrt(x * x + y * y + z * z);
+            normal[0] = x / length;
+            normal[1] = y / length;
+            normal[2] = z / length;
+        }
+
+#ifdef SPAN_KERNEL_X86
+        void cpuid(int leaf, int subleaf, int(&registers)[4])
+        {
+#if defined(_MSC_VER)
+            __cpuidex(registers, leaf, subleaf);
+#else
+            __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+        }
+
+        std::uint64_t readExtendedControlRegister()
+        {
+#if defined(_MSC_VER)
+            return _xgetbv(0);
+#else
+            std::uint32_t eax, edx;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return static_cast<std::uint64_t>(edx) << 32 | eax;
+#endif
+        }
+#endif
+    }
+
+    template<typename TDepth>
+    unsigned shadeSpanScalar(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, unsigned* color)
+    {
+        const unsigned visible = testDepth<TDepth>(shader.depthTest, attributes.z, attributes.zStepX, coverage, depth);
+
+        for (int i = 0; i < SPAN_WIDTH; i++)
+        {
+            if (!(visible & 1u << i))
+                continue;
+
+            const Surface surface = fetchSurface(shader, attributes, i);
+            const std::uint8_t* diffuse = shader.diffuseMap.texels
+                + 3 * texelIndex(shader.diffuseMap.width, shader.diffuseMap.height, surface.u, surface.v);
+
+            color[i] = shade(shader.lighting, surface.normal, surface.world, surface.ks, diffuse);
+        }
+
+        return visible;
+    }
+
+    template<typename TDepth>
+    void depthSpanScalar(double z, double zStepX, unsigned coverage, void* spanDepth)
+    {
+        using Encoding = DepthEncoding<TDepth>;
+        TDepth* const depth = static_cast<TDepth*>(spanDepth);
+
+        for (int i = 0; i < SPAN_WIDTH; i++)
+        {
+            const double pixelZ = z + zStepX * i;
+
+            if (!(coverage & 1u << i) || pixelZ <= 0)
+                continue;
+
+            const TDepth encoded = Encoding::encode(pixelZ);
+
+            if (Encoding::isInFront(encoded, depth[i]))
+                depth[i] = encoded;
+        }
+    }
+
+    template<typename TDepth>
+    unsigned writeGBufferSpanScalar(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, GBufferTexel* texels)
+    {
+        const unsigned visible = testDepth<TDepth>(shader.depthTest, attributes.z, attributes.zStepX, coverage, depth);
+
+        for (int i = 0; i < SPAN_WIDTH; i++)
+        {
+            if (!(visible & 1u << i))
+                continue;
+
+            const Surface surface = fetchSurface(shader, attributes, i);
+
+            const float* normal = surface.normal;
+
+            texels[i] = {
+                encodeNormal(surface.normal),
+                shader.material << 8 | toUnorm(surface.ks, 0xFF),
+                surface.u,
+                surface.v,
+                std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2])
+            };
+        }
+
+        return visible;
+    }
+
+    template<typename TDepth>
+    unsigned writeVisibilitySpanScalar(double z, double zStepX, SpanDepthTest depthTest, std::uint32_t id, unsigned coverage, void* depth, std::uint32_t* ids)
+    {
+        const unsigned visible = testDepth<TDepth>(depthTest, z, zStepX, coverage, depth);
+
+        for (int i = 0; i < SPAN_WIDTH; i++)
+            if (visible & 1u << i)
+                ids[i] = id;
+
+        return visible;
+    }
+
+    template<typename TDepth>
+    unsigned lightSpanScalar(const DeferredLighting& lighting, int x, int y, unsigned coverage, const void* spanDepth, const GBufferTexel* texels, unsigned* color)
+    {
+        using Encoding = DepthEncoding<TDepth>;
+
+        const TDepth* const depth = static_cast<const TDepth*>(spanDepth);
+        const auto& m = lighting.screenToWorld;
+        unsigned lit = 0;
+
+        for (int i = 0; i < SPAN_WIDTH; i++)
+        {
+            if (!(coverage & 1u << i) || !Encoding::isSurface(depth[i]))
+                continue;
+
+            lit |= 1u << i;
+
+            const double z = Encoding::decode(depth[i]);
+
+            // World position at the pixel center
+            const double screenX = x + i + 0.5;
+            const double screenY = y + 0.5;
+            const double w = (z - m[3][3]) / (m[3][0] * screenX + m[3][1] * screenY + m[3][2]);
+
+            float world[3];
+            for (int c = 0; c < 3; c++)
+                world[c] = static_cast<float>(w * (m[c][0] * screenX + m[c][1] * screenY + m[c][2]) + m[c][3]);
+
+            const GBufferTexel& texel = texels[i];
+            const SpanTexture<std::uint8_t>& diffuseMap = lighting.diffuseMaps[texel.material >> 8];
+            const std::uint8_t* diffuse = diffuseMap.texels + 3 * texelIndex(diffuseMap.width, diffuseMap.height, texel.u, texel.v);
+
+            float normal[3];
+            decodeNormal(texel.normal, normal);
+
+            for (float& component : normal)
+                component *= texel.normalLength;
+
+            color[i] = shade(lighting.lighting, normal, world, fromUnorm(texel.material & 0xFF, 0xFF), diffuse);
+        }
+
+        return lit;
+    }
+
+    bool isAvx2Supported()
+    {
+#ifdef SPAN_KERNEL_X86
+        int registers[4];
+
+        cpuid(0, 0, registers);
+        if (registers[0] < 7)
+            return false;
+
+        cpuid(1, 0, registers);
+        const bool hasFma = registers[2] & 1 << 12;
+        const bool hasOsxsave = registers[2] & 1 << 27;
+        const bool hasAvx = registers[2] & 1 << 28;
+
+        if (!hasFma || !hasOsxsave || !hasAvx)
+            return false;
+
+        // OS saves XMM and YMM state on context switches
+        if ((readExtendedControlRegister() & 0x6) != 0x6)
+            return false;
+
+        cpuid(7, 0, registers);
+        return registers[1] & 1 << 5;
+#else
+        return false;
+#endif
+    }
+
+    template<typename TDepth>
+    ShadeSpanKernel selectShadeSpanKernel()
+    {
+#ifdef SPAN_KERNEL_X86
+        if (isAvx2Supported())
+            return &shadeSpanAvx2<TDepth>;
+#endif
+        return &shadeSpanScalar<TDepth>;
+    }
+
+    template<typename TDepth>
+    DepthSpanKernel selectDepthSpanKernel()
+    {
+#ifdef SPAN_KERNEL_X86
+        if (isAvx2Supported())
+            return &depthSpanAvx2<TDepth>;
+#endif
+        return &depthSpanScalar<TDepth>;
+    }
+
+    template<typename TDepth>
+    GBufferSpanKernel selectGBufferSpanKernel()
+    {
+#ifdef SPAN_KERNEL_X86
+        if (isAvx2Supported())
+            return &writeGBufferSpanAvx2<TDepth>;
+#endif
+        return &writeGBufferSpanScalar<TDepth>;
+    }
+
+    template<typename TDepth>
+    VisibilitySpanKernel selectVisibilitySpanKernel()
+    {
+#ifdef SPAN_KERNEL_X86
+        if (isAvx2Supported())
+            return &writeVisibilitySpanAvx2<TDepth>;
+#endif
+        return &writeVisibilitySpanScalar<TDepth>;
+    }
+
+    template<typename TDepth>
+    LightSpanKernel selectLightSpanKernel()
+    {
+#ifdef SPAN_KERNEL_X86
+        if (isAvx2Supported())
+            return &lightSpanAvx2<TDepth>;
+#endif
+        return &lightSpanScalar<TDepth>;
+    }
+
+    template ShadeSpanKernel selectShadeSpanKernel<double>();
+    template ShadeSpanKernel selectShadeSpanKernel<float>();
+    template DepthSpanKernel selectDepthSpanKernel<double>();
+    template DepthSpanKernel selectDepthSpanKernel<float>();
+    template GBufferSpanKernel selectGBufferSpanKernel<double>();
+    template GBufferSpanKernel selectGBufferSpanKernel<float>();
+    template VisibilitySpanKernel selectVisibilitySpanKernel<double>();
+    template VisibilitySpanKernel selectVisibilitySpanKernel<float>();
+    template LightSpanKernel selectLightSpanKernel<double>();
+    template LightSpanKernel selectLightSpanKernel<float>();
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+
+// This header is shared with SpanKernelAvx2.cpp which is compiled with AVX2 enabled. It must not
+// pull in inline code used by the rest of the engine (pch.h, math, maps): the linker could keep the
+// AVX2 copy of such code and crash on CPUs without AVX2.
+
+namespace ModelViewer::Engine
+{
+    constexpr int SPAN_WIDTH = 8;
+
+    // Texture laid out as in DiffuseMap, NormalMap and SpecularMap (rows stored bottom up and mirrored)
+    template<typename T>
+    struct SpanTexture
+    {
+        const T* texels;
+        std::int32_t width;
+        std::int32_t height;
+    };
+
+    // Phong terms with reflection coefficients and 1 / Color::MAX premultiplied into the colors
+    struct SpanLighting
+    {
+        float ambient[3];
+        float diffuse[3];
+        float specular[3];
+        float lightDirection[3];
+        float viewPosition[3];
+    };
+
+    enum class SpanDepthTest : std::int32_t
+    {
+        // Passes in front of the depth and writes it
+        LESS,
+        // Passes at the depth laid down by a depth only pass and writes it negated, so a pixel is
+        // shaded once even if several triangles have the same depth there
+        EQUAL,
+        // Passes every covered pixel and leaves depth as is, for shading the visibility buffer
+        ALWAYS
+    };
+
+    // Everything that is constant during a draw call
+    struct SpanShader
+    {
+        SpanTexture<std::uint8_t> diffuseMap;   // 3 channels per texel
+        SpanTexture<double> normalMap;          // 3 components per texel
+        SpanTexture<double> specularMap;
+        float normalMatrix[3][3];               // Rows, takes normal map texels to world space
+        SpanLighting lighting;
+        SpanDepthTest depthTest;
+        std::uint32_t material;                 // Written to the G-buffer by deferred shading, the triangle in the visibility buffer
+    };
+
+    // Value of the attribute at the first pixel of the span and its growth per pixel along X
+    struct SpanValue
+    {
+        float value;
+        float stepX;
+    };
+
+    // UV and world vertex are divided by z, the kernel restores them with 1 / invZ
+    struct SpanAttributes
+    {
+        double z;
+        double zStepX;
+        SpanValue invZ;
+        SpanValue u;
+        SpanValue v;
+        SpanValue worldX;
+        SpanValue worldY;
+        SpanValue worldZ;
+    };
+
+    // Surface of a pixel written by deferred shading in place of its color
+    struct GBufferTexel
+    {
+        std::uint32_t normal;       // World space, octahedral, 16 bit signed normalized X and Y, X in the low half
+        std::uint32_t material;     // Index in DeferredLighting::diffuseMaps above 8 bits of specular
+        float u;                    // As the shading kernels compute them, so the same diffuse texel is picked
+        float v;
+        float normalLength;         // Normals are not unit, the specular term of the shading kernels depends on their length
+    };
+
+    // Everything that is constant during the lighting pass of a frame
+    struct DeferredLighting
+    {
+        const SpanTexture<std::uint8_t>* diffuseMaps;   // By material
+        // World position of the screen point (x, y) with homogeneous w is w * (m[c][0] * x + m[c][1] * y + m[c][2]) + m[c][3]
+        // for rows c up to 2, w of depth z is (z - m[3][3]) / (m[3][0] * x + m[3][1] * y + m[3][2])
+        double screenToWorld[4][4];
+        SpanLighting lighting;
+    };
+
+    // Kernels are instantiated for depth buffers of TDepth: double holds depth z, float holds 1 / z
+    // with nearer being greater (DepthFormat in FrameBuffer.h). z is interpolated in double either way.
+
+    // Depth tests, shades and writes up to SPAN_WIDTH pixels starting at depth[0] and color[0].
+    // Bit i of coverage enables pixel i, disabled pixels are neither read nor written.
+    // Returns the pixels that passed the depth test.
+    using ShadeSpanKernel = unsigned(*)(const SpanShader& shader, const SpanAttributes& attributes,
+        unsigned coverage, void* depth, unsigned* color);
+
+    // Depth tests and writes the pixels of a span without shading them. Depth is computed exactly
+    // as in the shading kernel of the same instruction set, so a later EQUAL test matches.
+    using DepthSpanKernel = void(*)(double z, double zStepX, unsigned coverage, void* depth);
+
+    // Depth tests as ShadeSpanKernel, writes surfaces of the pixels that passed to the G-buffer instead of shading them
+    using GBufferSpanKernel = unsigned(*)(const SpanShader& shader, const SpanAttributes& attributes,
+        unsigned coverage, void* depth, GBufferTexel* texels);
+
+    // Depth tests as ShadeSpanKernel and writes id to the visibility buffer for the pixels that passed
+    using VisibilitySpanKernel = unsigned(*)(double z, double zStepX, SpanDepthTest depthTest, std::uint32_t id,
+        unsigned coverage, void* depth, std::uint32_t* ids);
+
+    // Lights the pixels of the span starting at (x, y) that hold a surface, that is whose depth is not cleared.
+    // Returns the lit pixels.
+    using LightSpanKernel = unsigned(*)(const DeferredLighting& lighting, int x, int y, unsigned coverage,
+        const void* depth, const GBufferTexel* texels, unsigned* color);
+
+    template<typename TDepth>
+    unsigned shadeSpanScalar(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, unsigned* color);
+    template<typename TDepth>
+    unsigned shadeSpanAvx2(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, unsigned* color);
+    template<typename TDepth>
+    void depthSpanScalar(double z, double zStepX, unsigned coverage, void* depth);
+    template<typename TDepth>
+    void depthSpanAvx2(double z, double zStepX, unsigned coverage, void* depth);
+    template<typename TDepth>
+    unsigned writeGBufferSpanScalar(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, GBufferTexel* texels);
+    template<typename TDepth>
+    unsigned writeGBufferSpanAvx2(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, GBufferTexel* texels);
+    template<typename TDepth>
+    unsigned writeVisibilitySpanScalar(double z, double zStepX, SpanDepthTest depthTest, std::uint32_t id, unsigned coverage, void* depth, std::uint32_t* ids);
+    template<typename TDepth>
+    unsigned writeVisibilitySpanAvx2(double z, double zStepX, SpanDepthTest depthTest, std::uint32_t id, unsigned coverage, void* depth, std::uint32_t* ids);
+    template<typename TDepth>
+    unsigned lightSpanScalar(const DeferredLighting& lighting, int x, int y, unsigned coverage, const void* depth, const GBufferTexel* texels, unsigned* color);
+    template<typename TDepth>
+    unsigned lightSpanAvx2(const DeferredLighting& lighting, int x, int y, unsigned coverage, const void* depth, const GBufferTexel* texels, unsigned* color);
+
+    bool isAvx2Supported();
+
+    // Picks the widest kernel supported by the CPU for depth buffers of TDepth
+    template<typename TDepth>
+    ShadeSpanKernel selectShadeSpanKernel();
+    template<typename TDepth>
+    DepthSpanKernel selectDepthSpanKernel();
+    template<typename TDepth>
+    GBufferSpanKernel selectGBufferSpanKernel();
+    template<typename TDepth>
+    VisibilitySpanKernel selectVisibilitySpanKernel();
+    template<typename TDepth>
+    LightSpanKernel selectLightSpanKernel();
+}
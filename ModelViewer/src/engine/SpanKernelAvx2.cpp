@@ -0,0 +1,539 @@
+// Compiled with AVX2 and FMA enabled and without the precompiled header, see SpanKernel.h
+#include "SpanKernel.h"
+#include <cfloat>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace ModelViewer::Engine
+{
+    namespace
+    {
+        struct Vec3x8
+        {
+            __m256 x;
+            __m256 y;
+            __m256 z;
+        };
+
+        __m256 dot(const Vec3x8& a, const Vec3x8& b)
+        {
+            return _mm256_fmadd_ps(a.x, b.x, _mm256_fmadd_ps(a.y, b.y, _mm256_mul_ps(a.z, b.z)));
+        }
+
+        __m256 clampUnit(__m256 value)
+        {
+            // _mm256_max_ps returns the second operand for NaN lanes
+            return _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        }
+
+        __m256 interpolate(const SpanValue& attribute, __m256 lanes)
+        {
+            return _mm256_fmadd_ps(_mm256_set1_ps(attribute.stepX), lanes, _mm256_set1_ps(attribute.value));
+        }
+
+        template<typename T>
+        __m256i texelIndex(const SpanTexture<T>& texture, __m256 u, __m256 v)
+        {
+            const __m256i width = _mm256_set1_epi32(texture.width);
+            const __m256i count = _mm256_set1_epi32(texture.width * texture.height);
+            const __m256i row = _mm256_cvttps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(static_cast<float>(texture.height))));
+            const __m256i column = _mm256_cvttps_epi32(_mm256_mul_ps(u, _mm256_set1_ps(static_cast<float>(texture.width))));
+            const __m256i i = _mm256_sub_epi32(count, _mm256_add_epi32(_mm256_mullo_epi32(row, width), column));
+            // Clamped at both ends as in the scalar kernel
+            const __m256i last = _mm256_sub_epi32(count, _mm256_set1_epi32(1));
+            return _mm256_max_epi32(_mm256_min_epi32(i, last), _mm256_setzero_si256());
+        }
+
+        // Gathers one double per lane at texels[index * stride + offset]
+        __m256 gather(const double* texels, __m256i index, int stride, int offset)
+        {
+            const __m256i element = _mm256_add_epi32(_mm256_mullo_epi32(index, _mm256_set1_epi32(stride)), _mm256_set1_epi32(offset));
+            // Masked gathers from a zeroed source, the unmasked ones leave GCC warning about an uninitialized source
+            const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+            const __m128 low = _mm256_cvtpd_ps(_mm256_mask_i32gather_pd(_mm256_setzero_pd(), texels, _mm256_castsi256_si128(element), all, 8));
+            const __m128 high = _mm256_cvtpd_ps(_mm256_mask_i32gather_pd(_mm256_setzero_pd(), texels, _mm256_extracti128_si256(element, 1), all, 8));
+            return _mm256_set_m128(high, low);
+        }
+
+        Vec3x8 transform(const float(&matrix)[3][3], const Vec3x8& v)
+        {
+            Vec3x8 out;
+            __m256* const rows[3] = { &out.x, &out.y, &out.z };
+
+            for (int row = 0; row < 3; row++)
+            {
+                *rows[row] = _mm256_fmadd_ps(_mm256_set1_ps(matrix[row][0]), v.x,
+                    _mm256_fmadd_ps(_mm256_set1_ps(matrix[row][1]), v.y, _mm256_mul_ps(_mm256_set1_ps(matrix[row][2]), v.z)));
+            }
+
+            return out;
+        }
+
+        __m256i coverageMask32(unsigned coverage)
+        {
+            const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+            return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(coverage)), bits), bits);
+        }
+
+        __m256i coverageMask64(unsigned coverage)
+        {
+            const __m256i bits = _mm256_setr_epi64x(1, 2, 4, 8);
+            return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(coverage), bits), bits);
+        }
+
+        // Depth of the pixels of a span as stored in depth buffers of TDepth, see SpanKernel.h
+        template<typename TDepth>
+        struct SpanDepth;
+
+        // Depth z in double precision, 4 lanes at a time
+        template<>
+        struct SpanDepth<double>
+        {
+            static constexpr int IN_FRONT = _CMP_LT_OQ;
+
+            __m256d low;
+            __m256d high;
+
+            SpanDepth(double z, double zStepX)
+                :
+                low(_mm256_fmadd_pd(_mm256_set1_pd(zStepX), _mm256_setr_pd(0, 1, 2, 3), _mm256_set1_pd(z))),
+                high(_mm256_fmadd_pd(_mm256_set1_pd(zStepX), _mm256_setr_pd(4, 5, 6, 7), _mm256_set1_pd(z)))
+            {
+            }
+
+            // Covered pixels in front of the camera for which depth compares with the predicate
+            template<int predicate>
+            unsigned test(unsigned coverage, const double* depth) const
+            {
+                const __m256d depthLow = _mm256_maskload_pd(depth, coverageMask64(coverage));
+                const __m256d depthHigh = _mm256_maskload_pd(depth + 4, coverageMask64(coverage >> 4));
+
+                const __m256d zero = _mm256_setzero_pd();
+                const __m256d passedLow = _mm256_and_pd(_mm256_cmp_pd(low, zero, _CMP_GT_OQ), _mm256_cmp_pd(low, depthLow, predicate));
+                const __m256d passedHigh = _mm256_and_pd(_mm256_cmp_pd(high, zero, _CMP_GT_OQ), _mm256_cmp_pd(high, depthHigh, predicate));
+
+                return coverage & static_cast<unsigned>(_mm256_movemask_pd(passedLow) | _mm256_movemask_pd(passedHigh) << 4);
+            }
+
+            void store(unsigned coverage, double* depth, bool isNegated) const
+            {
+                const __m256d sign = isNegated ? _mm256_set1_pd(-0.0) : _mm256_setzero_pd();
+                _mm256_maskstore_pd(depth, coverageMask64(coverage), _mm256_xor_pd(low, sign));
+                _mm256_maskstore_pd(depth + 4, coverageMask64(coverage >> 4), _mm256_xor_pd(high, sign));
+            }
+        };
+
+        // Reversed 1 / z, interpolated and inverted in double precision and rounded to float once
+        template<>
+        struct SpanDepth<float>
+        {
+            static constexpr int IN_FRONT = _CMP_GT_OQ;
+
+            __m256 encoded;
+            unsigned inFrontOfCamera;
+
+            SpanDepth(double z, double zStepX)
+            {
+                const __m256d low = _mm256_fmadd_pd(_mm256_set1_pd(zStepX), _mm256_setr_pd(0, 1, 2, 3), _mm256_set1_pd(z));
+                const __m256d high = _mm256_fmadd_pd(_mm256_set1_pd(zStepX), _mm256_setr_pd(4, 5, 6, 7), _mm256_set1_pd(z));
+                const __m256d one = _mm256_set1_pd(1.0);
+                const __m256d zero = _mm256_setzero_pd();
+
+                encoded = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_div_pd(one, high)), _mm256_cvtpd_ps(_mm256_div_pd(one, low)));
+                inFrontOfCamera = static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(low, zero, _CMP_GT_OQ))
+                    | _mm256_movemask_pd(_mm256_cmp_pd(high, zero, _CMP_GT_OQ)) << 4);
+            }
+
+            template<int predicate>
+            unsigned test(unsigned coverage, const float* depth) const
+            {
+                const __m256 stored = _mm256_maskload_ps(depth, coverageMask32(coverage));
+                return coverage & inFrontOfCamera & static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(encoded, stored, predicate)));
+            }
+
+            void store(unsigned coverage, float* depth, bool isNegated) const
+            {
+                const __m256 sign = isNegated ? _mm256_set1_ps(-0.0f) : _mm256_setzero_ps();
+                _mm256_maskstore_ps(depth, coverageMask32(coverage), _mm256_xor_ps(encoded, sign));
+            }
+        };
+
+        // Passing pixels of a span, with the EQUAL test their depth is written negated
+        template<typename TDepth>
+        unsigned testDepth(SpanDepthTest depthTest, double z, double zStepX, unsigned coverage, void* spanDepth)
+        {
+            if (depthTest == SpanDepthTest::ALWAYS)
+                return coverage;
+
+            TDepth* const depth = static_cast<TDepth*>(spanDepth);
+            const SpanDepth<TDepth> encoded(z, zStepX);
+            const bool isEqualTest = depthTest == SpanDepthTest::EQUAL;
+            const unsigned visible = isEqualTest
+                ? encoded.template test<_CMP_EQ_OQ>(coverage, depth)
+                : encoded.template test<SpanDepth<TDepth>::IN_FRONT>(coverage, depth);
+
+            if (visible)
+                encoded.store(visible, depth, isEqualTest);
+
+            return visible;
+        }
+
+        // Depth z of the pixels of a span in halves of 4 lanes, returns the covered pixels that hold a surface
+        unsigned loadSurfaces(unsigned coverage, const double* depth, __m256d(&z)[2])
+        {
+            z[0] = _mm256_maskload_pd(depth, coverageMask64(coverage));
+            z[1] = _mm256_maskload_pd(depth + 4, coverageMask64(coverage >> 4));
+
+            const __m256d zero = _mm256_setzero_pd();
+            const __m256d cleared = _mm256_set1_pd(DBL_MAX);
+            const __m256d surfaceLow = _mm256_and_pd(_mm256_cmp_pd(z[0], zero, _CMP_GT_OQ), _mm256_cmp_pd(z[0], cleared, _CMP_LT_OQ));
+            const __m256d surfaceHigh = _mm256_and_pd(_mm256_cmp_pd(z[1], zero, _CMP_GT_OQ), _mm256_cmp_pd(z[1], cleared, _CMP_LT_OQ));
+
+            return coverage & static_cast<unsigned>(_mm256_movemask_pd(surfaceLow) | _mm256_movemask_pd(surfaceHigh) << 4);
+        }
+
+        unsigned loadSurfaces(unsigned coverage, const float* depth, __m256d(&z)[2])
+        {
+            const __m256 stored = _mm256_maskload_ps(depth, coverageMask32(coverage));
+            const __m256d one = _mm256_set1_pd(1.0);
+
+            z[0] = _mm256_div_pd(one, _mm256_cvtps_pd(_mm256_castps256_ps128(stored)));
+            z[1] = _mm256_div_pd(one, _mm256_cvtps_pd(_mm256_extractf128_ps(stored, 1)));
+
+            return coverage & static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(stored, _mm256_setzero_ps(), _CMP_GT_OQ)));
+        }
+
+        // Perspective correct attributes and map texels of the pixels of a span
+        struct Surface
+        {
+            __m256 u;
+            __m256 v;
+            Vec3x8 world;
+            Vec3x8 normal;  // World space, not normalized
+            __m256 ks;
+        };
+
+        Surface fetchSurface(const SpanShader& shader, const SpanAttributes& attributes)
+        {
+            Surface surface;
+
+            const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256 w = _mm256_div_ps(_mm256_set1_ps(1.0f), interpolate(attributes.invZ, lanes));
+            surface.u = clampUnit(_mm256_mul_ps(interpolate(attributes.u, lanes), w));
+            surface.v = clampUnit(_mm256_mul_ps(interpolate(attributes.v, lanes), w));
+            surface.world = {
+                _mm256_mul_ps(interpolate(attributes.worldX, lanes), w),
+                _mm256_mul_ps(interpolate(attributes.worldY, lanes), w),
+                _mm256_mul_ps(interpolate(attributes.worldZ, lanes), w)
+            };
+
+            const __m256i normalIndex = texelIndex(shader.normalMap, surface.u, surface.v);
+            surface.normal = transform(shader.normalMatrix, {
+                gather(shader.normalMap.texels, normalIndex, 3, 0),
+                gather(shader.normalMap.texels, normalIndex, 3, 1),
+                gather(shader.normalMap.texels, normalIndex, 3, 2)
+            });
+            surface.ks = gather(shader.specularMap.texels, texelIndex(shader.specularMap, surface.u, surface.v), 1, 0);
+
+            return surface;
+        }
+
+        // Phong with shininess of 4, returns pixels as 0x00RRGGBB
+        __m256i shade(const SpanLighting& lighting, const Vec3x8& normal, const Vec3x8& world, __m256 ks,
+            const std::int32_t(&diffuseChannels)[3][SPAN_WIDTH])
+        {
+            const Vec3x8 light = {
+                _mm256_set1_ps(lighting.lightDirection[0]),
+                _mm256_set1_ps(lighting.lightDirection[1]),
+                _mm256_set1_ps(lighting.lightDirection[2])
+            };
+
+            const __m256 zeroPs = _mm256_setzero_ps();
+            const __m256 normalDotLight = dot(normal, light);
+            const __m256 cosTheta = _mm256_max_ps(_mm256_div_ps(normalDotLight, _mm256_sqrt_ps(dot(normal, normal))), zeroPs);
+
+            const __m256 twiceNormalDotLight = _mm256_add_ps(normalDotLight, normalDotLight);
+            const Vec3x8 reflection = {
+                _mm256_fnmadd_ps(normal.x, twiceNormalDotLight, light.x),
+                _mm256_fnmadd_ps(normal.y, twiceNormalDotLight, light.y),
+                _mm256_fnmadd_ps(normal.z, twiceNormalDotLight, light.z)
+            };
+            const Vec3x8 view = {
+                _mm256_sub_ps(_mm256_set1_ps(lighting.viewPosition[0]), world.x),
+                _mm256_sub_ps(_mm256_set1_ps(lighting.viewPosition[1]), world.y),
+                _mm256_sub_ps(_mm256_set1_ps(lighting.viewPosition[2]), world.z)
+            };
+
+            const __m256 cosAlpha = _mm256_max_ps(_mm256_div_ps(dot(reflection, view),
+                _mm256_sqrt_ps(_mm256_mul_ps(dot(reflection, reflection), dot(view, view)))), zeroPs);
+
+            // Specular light exists only on the lit side
+            const __m256 cosAlphaSquared = _mm256_mul_ps(cosAlpha, cosAlpha);
+            const __m256 specularFactor = _mm256_and_ps(_mm256_cmp_ps(cosTheta, zeroPs, _CMP_GT_OQ),
+                _mm256_mul_ps(_mm256_mul_ps(cosAlphaSquared, cosAlphaSquared), ks));
+
+            const __m256 maxChannel = _mm256_set1_ps(255.0f);
+            __m256i pixel = _mm256_setzero_si256();
+
+            for (int c = 0; c < 3; c++)
+            {
+                const __m256 intensity = _mm256_fmadd_ps(_mm256_set1_ps(lighting.specular[c]), specularFactor,
+                    _mm256_fmadd_ps(_mm256_set1_ps(lighting.diffuse[c]), cosTheta, _mm256_set1_ps(lighting.ambient[c])));
+                const __m256 base = _mm256_cvtepi32_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(diffuseChannels[c])));
+                const __m256 channel = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(intensity, base), zeroPs), maxChannel);
+
+                pixel = _mm256_or_si256(_mm256_slli_epi32(pixel, 8), _mm256_cvttps_epi32(channel));
+            }
+
+            return pixel;
+        }
+
+        __m256i toUnorm(__m256 value, int max)
+        {
+            return _mm256_cvtps_epi32(_mm256_mul_ps(clampUnit(value), _mm256_set1_ps(static_cast<float>(max))));
+        }
+
+        __m256 fromUnorm(__m256i value, int max)
+        {
+            return _mm256_div_ps(_mm256_cvtepi32_ps(value), _mm256_set1_ps(static_cast<float>(max)));
+        }
+
+        // Both halves of the octahedral encoding, see encodeNormal in SpanKernel.cpp
+        __m256 signOf(__m256 value)
+        {
+            return _mm256_blendv_ps(_mm256_set1_ps(-1.0f), _mm256_set1_ps(1.0f), _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        __m256 absOf(__m256 value)
+        {
+            return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), value);
+        }
+
+        __m256i encodeNormal(const Vec3x8& normal)
+        {
+            const __m256 length = _mm256_add_ps(_mm256_add_ps(absOf(normal.x), absOf(normal.y)), absOf(normal.z));
+            const __m256 isValid = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+
+            // Zero normals turn into +Z
+            const __m256 x = _mm256_and_ps(_mm256_div_ps(normal.x, length), isValid);
+            const __m256 y = _mm256_and_ps(_mm256_div_ps(normal.y, length), isValid);
+
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 isLower = _mm256_and_ps(_mm256_cmp_ps(normal.z, _mm256_setzero_ps(), _CMP_LT_OQ), isValid);
+            const __m256 foldedX = _mm256_blendv_ps(x, _mm256_mul_ps(_mm256_sub_ps(one, absOf(y)), signOf(x)), isLower);
+            const __m256 foldedY = _mm256_blendv_ps(y, _mm256_mul_ps(_mm256_sub_ps(one, absOf(x)), signOf(y)), isLower);
+
+            const __m256 scale = _mm256_set1_ps(32767.0f);
+            const __m256 minusOne = _mm256_set1_ps(-1.0f);
+            const __m256i packedX = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(foldedX, minusOne), one), scale));
+            const __m256i packedY = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(foldedY, minusOne), one), scale));
+
+            return _mm256_or_si256(_mm256_and_si256(packedX, _mm256_set1_epi32(0xFFFF)), _mm256_slli_epi32(packedY, 16));
+        }
+
+        Vec3x8 decodeNormal(__m256i packed)
+        {
+            // Sign extension of the 16 bit halves
+            const __m256 scale = _mm256_set1_ps(32767.0f);
+            __m256 x = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(packed, 16), 16)), scale);
+            __m256 y = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(packed, 16)), scale);
+            const __m256 z = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), absOf(x)), absOf(y));
+
+            // Unfold the lower half
+            const __m256 fold = _mm256_max_ps(_mm256_sub_ps(_mm256_setzero_ps(), z), _mm256_setzero_ps());
+            x = _mm256_sub_ps(x, _mm256_mul_ps(fold, signOf(x)));
+            y = _mm256_sub_ps(y, _mm256_mul_ps(fold, signOf(y)));
+
+            const Vec3x8 unnormalized = { x, y, z };
+            const __m256 length = _mm256_sqrt_ps(dot(unnormalized, unnormalized));
+
+            return { _mm256_div_ps(x, length), _mm256_div_ps(y, length), _mm256_div_ps(z, length) };
+        }
+    }
+
+    template<typename TDepth>
+    void depthSpanAvx2(double z, double zStepX, unsigned coverage, void* spanDepth)
+    {
+        TDepth* const depth = static_cast<TDepth*>(spanDepth);
+        const SpanDepth<TDepth> encoded(z, zStepX);
+        const unsigned visible = encoded.template test<SpanDepth<TDepth>::IN_FRONT>(coverage, depth);
+
+        if (visible)
+            encoded.store(visible, depth, false);
+    }
+
+    template<typename TDepth>
+    unsigned shadeSpanAvx2(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, unsigned* color)
+    {
+        const unsigned visible = testDepth<TDepth>(shader.depthTest, attributes.z, attributes.zStepX, coverage, depth);
+
+        if (!visible)
+            return 0;
+
+        const Surface surface = fetchSurface(shader, attributes);
+
+        // Colors are 3 bytes wide, a 4 byte gather could read past the end of the map
+        alignas(32) std::int32_t diffuseIndices[SPAN_WIDTH];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(diffuseIndices), texelIndex(shader.diffuseMap, surface.u, surface.v));
+
+        alignas(32) std::int32_t diffuseChannels[3][SPAN_WIDTH];
+        for (int i = 0; i < SPAN_WIDTH; i++)
+        {
+            const std::uint8_t* texel = shader.diffuseMap.texels + 3 * diffuseIndices[i];
+            diffuseChannels[0][i] = texel[0];
+            diffuseChannels[1][i] = texel[1];
+            diffuseChannels[2][i] = texel[2];
+        }
+
+        const __m256i pixel = shade(shader.lighting, surface.normal, surface.world, surface.ks, diffuseChannels);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(color), coverageMask32(visible), pixel);
+
+        return visible;
+    }
+
+    template<typename TDepth>
+    unsigned writeGBufferSpanAvx2(const SpanShader& shader, const SpanAttributes& attributes, unsigned coverage, void* depth, GBufferTexel* texels)
+    {
+        const unsigned visible = testDepth<TDepth>(shader.depthTest, attributes.z, attributes.zStepX, coverage, depth);
+
+        if (!visible)
+            return 0;
+
+        const Surface surface = fetchSurface(shader, attributes);
+
+        alignas(32) std::uint32_t normals[SPAN_WIDTH];
+        alignas(32) std::uint32_t materials[SPAN_WIDTH];
+        alignas(32) float us[SPAN_WIDTH];
+        alignas(32) float vs[SPAN_WIDTH];
+        alignas(32) float normalLengths[SPAN_WIDTH];
+
+        _mm256_store_si256(reinterpret_cast<__m256i*>(normals), encodeNormal(surface.normal));
+        _mm256_store_ps(normalLengths, _mm256_sqrt_ps(dot(surface.normal, surface.normal)));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(materials), _mm256_or_si256(
+            _mm256_set1_epi32(static_cast<int>(shader.material << 8)), toUnorm(surface.ks, 0xFF)));
+        _mm256_store_ps(us, surface.u);
+        _mm256_store_ps(vs, surface.v);
+
+        for (int i = 0; i < SPAN_WIDTH; i++)
+            if (visible & 1u << i)
+                texels[i] = { normals[i], materials[i], us[i], vs[i], normalLengths[i] };
+
+        return visible;
+    }
+
+    template<typename TDepth>
+    unsigned writeVisibilitySpanAvx2(double z, double zStepX, SpanDepthTest depthTest, std::uint32_t id, unsigned coverage, void* depth, std::uint32_t* ids)
+    {
+        const unsigned visible = testDepth<TDepth>(depthTest, z, zStepX, coverage, depth);
+
+        if (visible)
+            _mm256_maskstore_epi32(reinterpret_cast<int*>(ids), coverageMask32(visible), _mm256_set1_epi32(static_cast<int>(id)));
+
+        return visible;
+    }
+
+    template<typename TDepth>
+    unsigned lightSpanAvx2(const DeferredLighting& lighting, int x, int y, unsigned coverage, const void* depth, const GBufferTexel* texels, unsigned* color)
+    {
+        __m256d depthZ[2];
+        const unsigned lit = loadSurfaces(coverage, static_cast<const TDepth*>(depth), depthZ);
+
+        if (!lit)
+            return 0;
+
+        alignas(32) std::uint32_t normals[SPAN_WIDTH] = {};
+        alignas(32) std::uint32_t materials[SPAN_WIDTH] = {};
+        alignas(32) float normalLengths[SPAN_WIDTH] = {};
+        float us[SPAN_WIDTH] = {};
+        float vs[SPAN_WIDTH] = {};
+
+        for (int i = 0; i < SPAN_WIDTH; i++)
+        {
+            if (lit & 1u << i)
+            {
+                normals[i] = texels[i].normal;
+                materials[i] = texels[i].material;
+                us[i] = texels[i].u;
+                vs[i] = texels[i].v;
+                normalLengths[i] = texels[i].normalLength;
+            }
+        }
+
+        const __m256i material = _mm256_load_si256(reinterpret_cast<const __m256i*>(materials));
+        const __m256 ks = fromUnorm(_mm256_and_si256(material, _mm256_set1_epi32(0xFF)), 0xFF);
+        const Vec3x8 unitNormal = decodeNormal(_mm256_load_si256(reinterpret_cast<const __m256i*>(normals)));
+        const __m256 normalLength = _mm256_load_ps(normalLengths);
+        const Vec3x8 normal = {
+            _mm256_mul_ps(unitNormal.x, normalLength),
+            _mm256_mul_ps(unitNormal.y, normalLength),
+            _mm256_mul_ps(unitNormal.z, normalLength)
+        };
+
+        // Diffuse maps differ between the lanes
+
+        alignas(32) std::int32_t diffuseChannels[3][SPAN_WIDTH] = {};
+        for (int i = 0; i < SPAN_WIDTH; i++)
+        {
+            if (!(lit & 1u << i))
+                continue;
+
+            const SpanTexture<std::uint8_t>& diffuseMap = lighting.diffuseMaps[materials[i] >> 8];
+            const std::int32_t count = diffuseMap.width * diffuseMap.height;
+            const std::int32_t index = count - (static_cast<std::int32_t>(vs[i] * static_cast<float>(diffuseMap.height)) * diffuseMap.width
+                + static_cast<std::int32_t>(us[i] * static_cast<float>(diffuseMap.width)));
+            // Clamped at both ends as texelIndex, without std::min whose AVX2 copy the linker could keep
+            const std::int32_t clamped = index < count - 1 ? index : count - 1;
+            const std::uint8_t* texel = diffuseMap.texels + 3 * (clamped > 0 ? clamped : 0);
+
+            diffuseChannels[0][i] = texel[0];
+            diffuseChannels[1][i] = texel[1];
+            diffuseChannels[2][i] = texel[2];
+        }
+
+        // World position at the pixel centers
+        const auto& m = lighting.screenToWorld;
+        const __m256d screenY = _mm256_set1_pd(y + 0.5);
+        __m128 world[3][2];
+
+        for (int half = 0; half < 2; half++)
+        {
+            const __m256d z = depthZ[half];
+            const __m256d screenX = _mm256_add_pd(_mm256_set1_pd(x + 0.5), half ? _mm256_setr_pd(4, 5, 6, 7) : _mm256_setr_pd(0, 1, 2, 3));
+
+            const auto rowAt = [&](int row)
+            {
+                return _mm256_fmadd_pd(_mm256_set1_pd(m[row][0]), screenX,
+                    _mm256_fmadd_pd(_mm256_set1_pd(m[row][1]), screenY, _mm256_set1_pd(m[row][2])));
+            };
+
+            const __m256d w = _mm256_div_pd(_mm256_sub_pd(z, _mm256_set1_pd(m[3][3])), rowAt(3));
+
+            for (int c = 0; c < 3; c++)
+                world[c][half] = _mm256_cvtpd_ps(_mm256_fmadd_pd(w, rowAt(c), _mm256_set1_pd(m[c][3])));
+        }
+
+        const Vec3x8 worldPosition = {
+            _mm256_set_m128(world[0][1], world[0][0]),
+            _mm256_set_m128(world[1][1], world[1][0]),
+            _mm256_set_m128(world[2][1], world[2][0])
+        };
+
+        const __m256i pixel = shade(lighting.lighting, normal, worldPosition, ks, diffuseChannels);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(color), coverageMask32(lit), pixel);
+
+        return lit;
+    }
+
+    template unsigned shadeSpanAvx2<double>(const SpanShader&, const SpanAttributes&, unsigned, void*, unsigned*);
+    template unsigned shadeSpanAvx2<float>(const SpanShader&, const SpanAttributes&, unsigned, void*, unsigned*);
+    template void depthSpanAvx2<double>(double, double, unsigned, void*);
+    template void depthSpanAvx2<float>(double, double, unsigned, void*);
+    template unsigned writeGBufferSpanAvx2<double>(const SpanShader&, const SpanAttributes&, unsigned, void*, GBufferTexel*);
+    template unsigned writeGBufferSpanAvx2<float>(const SpanShader&, const SpanAttributes&, unsigned, void*, GBufferTexel*);
+    template unsigned writeVisibilitySpanAvx2<double>(double, double, SpanDepthTest, std::uint32_t, unsigned, void*, std::uint32_t*);
+    template unsigned writeVisibilitySpanAvx2<float>(double, double, SpanDepthTest, std::uint32_t, unsigned, void*, std::uint32_t*);
+    template unsigned lightSpanAvx2<double>(const DeferredLighting&, int, int, unsigned, const void*, const GBufferTexel*, unsigned*);
+    template unsigned lightSpanAvx2<float>(const DeferredLighting&, int, int, unsigned, const void*, const GBufferTexel*, unsigned*);
+}
+#endif
@@ -16,7 +16,7 @@ namespace ModelViewer::Engine
             expect(v >= 0 && v <= 1);
             expect(width * height == data.size());
             const auto i = width * height - (static_cast<std::size_t>(v * height) * width + static_cast<std::size_t>(u * width));
-            return data[i];
+            return data[(std::min)(i, data.size() - 1)];
         }
         static SpecularMap fromTexture(const Texture& texture);
     };
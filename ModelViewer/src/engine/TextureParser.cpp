@@ -14,7 +14,9 @@ namespace ModelViewer::Engine
     {
         Texture out = {};
 
-        unsigned err = lodepng::decode(out.rawData, out.width, out.height, m_filename);
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned err = lodepng::decode(out.rawData, width, height, m_filename);
 
         if (err)
         {
@@ -24,6 +26,9 @@ namespace ModelViewer::Engine
             throw std::runtime_error(ss.str().c_str());
         }
 
+        out.width = width;
+        out.height = height;
+
         return out;
     }
 }
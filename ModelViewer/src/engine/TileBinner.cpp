@@ -0,0 +1,91 @@
+#include "pch.h"
+#include "TileBinner.h"
+#include "Core.h"
+#include "engine/DepthPyramid.h"
+
+namespace ModelViewer::Engine
+{
+    TileBinner::TileBinner(int width, int height)
+        :
+        m_width(width),
+        m_height(height),
+        m_countTilesX((width + TILE_SIZE - 1) / TILE_SIZE),
+        m_countTilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+        m_bins(static_cast<std::size_t>(m_countTilesX) * m_countTilesY)
+    {
+    }
+
+    void TileBinner::begin()
+    {
+        for (auto& bin : m_bins)
+            bin.clear();
+    }
+
+    void TileBinner::binTriangle(std::size_t indexSelector, double minX, double minY, double maxX, double maxY)
+    {
+        // Completely out of screen
+        if (maxX < 0 || maxY < 0 || minX >= m_width || minY >= m_height)
+            return;
+
+        const int firstTileX = (std::max)(0, static_cast<int>(minX) / TILE_SIZE);
+        const int firstTileY = (std::max)(0, static_cast<int>(minY) / TILE_SIZE);
+        const int lastTileX = (std::min)(m_countTilesX - 1, static_cast<int>(maxX) / TILE_SIZE);
+        const int lastTileY = (std::min)(m_countTilesY - 1, static_cast<int>(maxY) / TILE_SIZE);
+
+        for (int tileY = firstTileY; tileY <= lastTileY; tileY++)
+            for (int tileX = firstTileX; tileX <= lastTileX; tileX++)
+                m_bins[static_cast<std::size_t>(tileY) * m_countTilesX + tileX].push_back(indexSelector);
+    }
+
+    void TileBinner::binTriangle(std::size_t indexSelector, double minX, double minY, double maxX, double maxY, double minZ, const DepthPyramid& depth)
+    {
+        if (maxX < 0 || maxY < 0 || minX >= m_width || minY >= m_height)
+            return;
+
+        const int firstTileX = (std::max)(0, static_cast<int>(minX) / TILE_SIZE);
+        const int firstTileY = (std::max)(0, static_cast<int>(minY) / TILE_SIZE);
+        const int lastTileX = (std::min)(m_countTilesX - 1, static_cast<int>(maxX) / TILE_SIZE);
+        const int lastTileY = (std::min)(m_countTilesY - 1, static_cast<int>(maxY) / TILE_SIZE);
+
+        for (int tileY = firstTileY; tileY <= lastTileY; tileY++)
+        {
+            for (int tileX = firstTileX; tileX <= lastTileX; tileX++)
+            {
+                const double left = (std::max)(minX, static_cast<double>(tileX * TILE_SIZE));
+                const double top = (std::max)(minY, static_cast<double>(tileY * TILE_SIZE));
+                const double right = (std::min)(maxX, static_cast<double>((tileX + 1) * TILE_SIZE - 1));
+                const double bottom = (std::min)(maxY, static_cast<double>((tileY + 1) * TILE_SIZE - 1));
+
+                if (!depth.isOccluded(left, top, right, bottom, minZ))
+                    m_bins[static_cast<std::size_t>(tileY) * m_countTilesX + tileX].push_back(indexSelector);
+            }
+        }
+    }
+
+    std::size_t TileBinner::getTilesCount() const
+    {
+        return m_bins.size();
+    }
+
+    Tile TileBinner::getTile(std::size_t tileIndex) const
+    {
+        expect(tileIndex < m_bins.size());
+
+        const int left = static_cast<int>(tileIndex % m_countTilesX) * TILE_SIZE;
+        const int top = static_cast<int>(tileIndex / m_countTilesX) * TILE_SIZE;
+
+        return {
+            left,
+            top,
+            (std::min)(left + TILE_SIZE, m_width),
+            (std::min)(top + TILE_SIZE, m_height)
+        };
+    }
+
+    const std::vector<std::size_t>& TileBinner::getTriangles(std::size_t tileIndex) const
+    {
+        expect(tileIndex < m_bins.size());
+
+        return m_bins[tileIndex];
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "pch.h"
+
+namespace ModelViewer::Engine
+{
+    class DepthPyramid;
+
+    // Screen rectangle owned by exactly one worker while rasterizing: [left, right) x [top, bottom)
+    struct Tile
+    {
+        int left;
+        int top;
+        int right;
+        int bottom;
+    };
+
+    class TileBinner
+    {
+    public:
+        static constexpr int TILE_SIZE = 64;
+
+    public:
+        TileBinner(int width, int height);
+        void begin();
+        void binTriangle(std::size_t indexSelector, double minX, double minY, double maxX, double maxY);
+        // Skips tiles where the depth already drawn hides everything at minZ or farther
+        void binTriangle(std::size_t indexSelector, double minX, double minY, double maxX, double maxY, double minZ, const DepthPyramid& depth);
+        std::size_t getTilesCount() const;
+        Tile getTile(std::size_t tileIndex) const;
+        const std::vector<std::size_t>& getTriangles(std::size_t tileIndex) const;
+
+    private:
+        int m_width;
+        int m_height;
+        int m_countTilesX;
+        int m_countTilesY;
+
+        // Index selectors (offset of the first index in the scene wide index space) of the triangles
+        // overlapping each tile, kept in submission order. Capacity is reused between frames.
+        std::vector<std::vector<std::size_t>> m_bins;
+    };
+}
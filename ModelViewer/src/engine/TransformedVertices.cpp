@@ -0,0 +1,77 @@
+#include "pch.h"
+#include "TransformedVertices.h"
+
+namespace ModelViewer::Engine
+{
+    // Kernels read the positions through raw pointers
+    static_assert(sizeof(Vector4<double>) == 4 * sizeof(double));
+
+    TransformedVertices::TransformedVertices()
+        :
+        m_kernel(selectTransformVerticesKernel())
+    {
+    }
+
+    void TransformedVertices::resize(std::size_t count)
+    {
+        const std::size_t batchesCount = (count + VERTEX_BATCH - 1) / VERTEX_BATCH;
+
+        // Streams are laid out by capacity, so they are moved only when it grows
+        if (batchesCount > m_capacity)
+        {
+            m_capacity = batchesCount;
+            m_batches.resize(m_capacity * STREAMS_COUNT);
+
+            float** streams[STREAMS_COUNT] = {
+                &m_streams.screenX, &m_streams.screenY, &m_streams.screenZ, &m_streams.screenW,
+                &m_streams.worldX, &m_streams.worldY, &m_streams.worldZ
+            };
+
+            for (int i = 0; i < STREAMS_COUNT; i++)
+                *streams[i] = reinterpret_cast<float*>(m_batches.data() + i * m_capacity);
+        }
+
+        m_size = count;
+    }
+
+    void TransformedVertices::transform(const Matrix4<double>& screen, const Matrix4<double>& world, ArrayView<Vector4<double>> vertices,
+        std::size_t first)
+    {
+        // Kernels store whole batches at aligned addresses
+        expect(first % VERTEX_BATCH == 0);
+        expect(first + vertices.size() <= m_size);
+
+        // Matrices are indexed as (column, row)
+        VertexTransform transform;
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                transform.screen[row][column] = static_cast<float>(screen(column, row));
+
+                if (row < 3)
+                    transform.world[row][column] = static_cast<float>(world(column, row));
+            }
+        }
+
+        if (vertices.empty())
+            return;
+
+        const VertexStreams streams = {
+            m_streams.screenX + first, m_streams.screenY + first, m_streams.screenZ + first, m_streams.screenW + first,
+            m_streams.worldX + first, m_streams.worldY + first, m_streams.worldZ + first
+        };
+
+        m_kernel(transform, &vertices[0][0], vertices.size(), streams);
+    }
+
+    std::size_t TransformedVertices::size() const
+    {
+        return m_size;
+    }
+
+    const VertexStreams& TransformedVertices::getStreams() const
+    {
+        return m_streams;
+    }
+}
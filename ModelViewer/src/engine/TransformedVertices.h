@@ -0,0 +1,52 @@
+#pragma once
+#include "pch.h"
+#include "math/Vector.h"
+#include "math/Matrix.h"
+#include "engine/ArrayView.h"
+#include "engine/VertexKernel.h"
+
+namespace ModelViewer::Engine
+{
+    // Screen and world space positions of the meshes of a frame, stored as float streams.
+    // Screen x and y are divided by w, z is left as is.
+    class TransformedVertices
+    {
+    public:
+        TransformedVertices();
+        // Storage only grows, a smaller count keeps it
+        void resize(std::size_t count);
+        // Writes [first, first + vertices.size()), first must be a multiple of VERTEX_BATCH
+        void transform(const Matrix4<double>& screen, const Matrix4<double>& world, ArrayView<Vector4<double>> vertices,
+            std::size_t first = 0);
+        std::size_t size() const;
+        const VertexStreams& getStreams() const;
+
+        inline Vec4<double> getScreenVertex(std::size_t index) const
+        {
+            expect(index < m_size);
+            return Vec4<double>({ m_streams.screenX[index], m_streams.screenY[index], m_streams.screenZ[index], m_streams.screenW[index] });
+        }
+
+        inline Vec3<double> getWorldVertex(std::size_t index) const
+        {
+            expect(index < m_size);
+            return Vec3<double>({ m_streams.worldX[index], m_streams.worldY[index], m_streams.worldZ[index] });
+        }
+
+    private:
+        struct alignas(32) Batch
+        {
+            float lanes[VERTEX_BATCH];
+        };
+
+        static constexpr int STREAMS_COUNT = sizeof(VertexStreams) / sizeof(float*);
+
+    private:
+        TransformVerticesKernel m_kernel;
+        std::vector<Batch> m_batches;
+        VertexStreams m_streams = {};
+        std::size_t m_size = 0;
+        // Batches per stream
+        std::size_t m_capacity = 0;
+    };
+}
@@ -0,0 +1,71 @@
+#include "pch.h"
+#include "VertexKernel.h"
+#include "engine/SpanKernel.h"
+
+namespace ModelViewer::Engine
+{
+    void transformVerticesScalar(const VertexTransform& transform, const double* positions, std::size_t count, const VertexStreams& streams)
+    {
+        const auto& s = transform.screen;
+        const auto& m = transform.world;
+
+        for (std::size_t first = 0; first < count; first += VERTEX_BATCH)
+        {
+            const std::size_t lanes = (std::min)(count - first, static_cast<std::size_t>(VERTEX_BATCH));
+
+            // Batches are transposed first, so the arithmetic below works on whole lanes
+            float x[VERTEX_BATCH] = {};
+            float y[VERTEX_BATCH] = {};
+            float z[VERTEX_BATCH] = {};
+            float w[VERTEX_BATCH] = {};
+
+            for (std::size_t i = 0; i < lanes; i++)
+            {
+                const double* position = positions + 4 * (first + i);
+                x[i] = static_cast<float>(position[0]);
+                y[i] = static_cast<float>(position[1]);
+                z[i] = static_cast<float>(position[2]);
+                w[i] = static_cast<float>(position[3]);
+            }
+
+            float screen[4][VERTEX_BATCH];
+            float world[3][VERTEX_BATCH];
+
+            for (int i = 0; i < VERTEX_BATCH; i++)
+            {
+                const float clipW = s[3][0] * x[i] + s[3][1] * y[i] + s[3][2] * z[i] + s[3][3] * w[i];
+
+                screen[0][i] = (s[0][0] * x[i] + s[0][1] * y[i] + s[0][2] * z[i] + s[0][3] * w[i]) / clipW;
+                screen[1][i] = (s[1][0] * x[i] + s[1][1] * y[i] + s[1][2] * z[i] + s[1][3] * w[i]) / clipW;
+                screen[2][i] = s[2][0] * x[i] + s[2][1] * y[i] + s[2][2] * z[i] + s[2][3] * w[i];
+                screen[3][i] = clipW;
+
+                for (int row = 0; row < 3; row++)
+                    world[row][i] = m[row][0] * x[i] + m[row][1] * y[i] + m[row][2] * z[i] + m[row][3] * w[i];
+            }
+
+            float* const outputs[7] = {
+                streams.screenX, streams.screenY, streams.screenZ, streams.screenW,
+                streams.worldX, streams.worldY, streams.worldZ
+            };
+
+            for (std::size_t i = 0; i < lanes; i++)
+            {
+                for (int stream = 0; stream < 4; stream++)
+                    outputs[stream][first + i] = screen[stream][i];
+
+                for (int stream = 0; stream < 3; stream++)
+                    outputs[4 + stream][first + i] = world[stream][i];
+            }
+        }
+    }
+
+    TransformVerticesKernel selectTransformVerticesKernel()
+    {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        if (isAvx2Supported())
+            return &transformVerticesAvx2;
+#endif
+        return &transformVerticesScalar;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+
+// This header is shared with VertexKernelAvx2.cpp which is compiled with AVX2 enabled, the same
+// rules as for SpanKernel.h apply.
+
+namespace ModelViewer::Engine
+{
+    // Vertices transformed at once, streams are allocated in whole batches
+    constexpr int VERTEX_BATCH = 8;
+
+    // Matrices as rows applied to column vectors
+    struct VertexTransform
+    {
+        // Model, view, projection and viewport, x and y are divided by w afterwards
+        float screen[4][4];
+        // Model only
+        float world[3][4];
+    };
+
+    // Structure of arrays, every stream is aligned to 32 bytes
+    struct VertexStreams
+    {
+        float* screenX;
+        float* screenY;
+        float* screenZ;
+        float* screenW;
+        float* worldX;
+        float* worldY;
+        float* worldZ;
+    };
+
+    // Transforms count vertices stored as 4 doubles each into the streams
+    using TransformVerticesKernel = void(*)(const VertexTransform& transform, const double* positions, std::size_t count,
+        const VertexStreams& streams);
+
+    void transformVerticesScalar(const VertexTransform& transform, const double* positions, std::size_t count, const VertexStreams& streams);
+    void transformVerticesAvx2(const VertexTransform& transform, const double* positions, std::size_t count, const VertexStreams& streams);
+
+    // Picks the widest kernel supported by the CPU
+    TransformVerticesKernel selectTransformVerticesKernel();
+}
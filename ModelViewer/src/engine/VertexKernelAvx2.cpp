@@ -0,0 +1,87 @@
+// Compiled with AVX2 and FMA enabled and without the precompiled header, see VertexKernel.h
+#include "VertexKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace ModelViewer::Engine
+{
+    namespace
+    {
+        struct Vec4x8
+        {
+            __m256 x;
+            __m256 y;
+            __m256 z;
+            __m256 w;
+        };
+
+        // Reads vertices first..first + 7 and transposes them into lanes
+        Vec4x8 loadBatch(const double* positions)
+        {
+            const auto load = [positions](int low, int high)
+            {
+                return _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(positions + 4 * high)),
+                    _mm256_cvtpd_ps(_mm256_loadu_pd(positions + 4 * low)));
+            };
+
+            // Vertex i in the low half, vertex i + 4 in the high half
+            const __m256 r0 = load(0, 4);
+            const __m256 r1 = load(1, 5);
+            const __m256 r2 = load(2, 6);
+            const __m256 r3 = load(3, 7);
+
+            const __m256 xy01 = _mm256_unpacklo_ps(r0, r1);
+            const __m256 zw01 = _mm256_unpackhi_ps(r0, r1);
+            const __m256 xy23 = _mm256_unpacklo_ps(r2, r3);
+            const __m256 zw23 = _mm256_unpackhi_ps(r2, r3);
+
+            return {
+                _mm256_shuffle_ps(xy01, xy23, 0x44),
+                _mm256_shuffle_ps(xy01, xy23, 0xEE),
+                _mm256_shuffle_ps(zw01, zw23, 0x44),
+                _mm256_shuffle_ps(zw01, zw23, 0xEE)
+            };
+        }
+
+        __m256 transformRow(const float(&row)[4], const Vec4x8& v)
+        {
+            return _mm256_fmadd_ps(_mm256_set1_ps(row[0]), v.x,
+                _mm256_fmadd_ps(_mm256_set1_ps(row[1]), v.y,
+                _mm256_fmadd_ps(_mm256_set1_ps(row[2]), v.z,
+                _mm256_mul_ps(_mm256_set1_ps(row[3]), v.w))));
+        }
+    }
+
+    void transformVerticesAvx2(const VertexTransform& transform, const double* positions, std::size_t count, const VertexStreams& streams)
+    {
+        const std::size_t batchesEnd = count - count % VERTEX_BATCH;
+
+        for (std::size_t first = 0; first < batchesEnd; first += VERTEX_BATCH)
+        {
+            const Vec4x8 v = loadBatch(positions + 4 * first);
+
+            const __m256 clipW = transformRow(transform.screen[3], v);
+            _mm256_store_ps(streams.screenX + first, _mm256_div_ps(transformRow(transform.screen[0], v), clipW));
+            _mm256_store_ps(streams.screenY + first, _mm256_div_ps(transformRow(transform.screen[1], v), clipW));
+            _mm256_store_ps(streams.screenZ + first, transformRow(transform.screen[2], v));
+            _mm256_store_ps(streams.screenW + first, clipW);
+
+            _mm256_store_ps(streams.worldX + first, transformRow(transform.world[0], v));
+            _mm256_store_ps(streams.worldY + first, transformRow(transform.world[1], v));
+            _mm256_store_ps(streams.worldZ + first, transformRow(transform.world[2], v));
+        }
+
+        // Positions are not padded, the last partial batch is left to the scalar kernel
+        if (batchesEnd < count)
+        {
+            const VertexStreams tail = {
+                streams.screenX + batchesEnd, streams.screenY + batchesEnd, streams.screenZ + batchesEnd, streams.screenW + batchesEnd,
+                streams.worldX + batchesEnd, streams.worldY + batchesEnd, streams.worldZ + batchesEnd
+            };
+
+            transformVerticesScalar(transform, positions + 4 * batchesEnd, count - batchesEnd, tail);
+        }
+    }
+}
+#endif
@@ -93,7 +93,7 @@ namespace ModelViewer
         template<typename T, std::size_t Size>
         constexpr Matrix<T, Size> createIdentityMatrix()
         {
-            Matrix<T, Size> out;
+            Matrix<T, Size> out(std::array<T, Size * Size>{});
             for (int i = 0; i < Size; i++)
             {
                 out(i, i) = static_cast<T>(1);
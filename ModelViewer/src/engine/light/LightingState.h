@@ -0,0 +1,27 @@
+#pragma once
+#include "pch.h"
+#include "math/Vector.h"
+#include "engine/SpanKernel.h"
+
+namespace ModelViewer
+{
+    namespace Engine
+    {
+        namespace Light
+        {
+            // Light setup shared by every fragment of a frame. Built once in Scene::render.
+            // Colors are premultiplied by their reflection coefficients and divided by Color::MAX.
+            struct LightingState
+            {
+                Vec3<double> ambient;
+                Vec3<double> diffuse;
+                Vec3<double> specular;
+                Vec3<double> lightDirection;
+                Vec3<double> viewPosition;
+
+                // The same values in the layout of span kernels
+                SpanLighting span;
+            };
+        }
+    }
+}
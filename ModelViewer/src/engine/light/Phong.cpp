@@ -7,6 +7,14 @@ namespace ModelViewer
     {
         namespace Light
         {
+            constexpr double ka = 0.5;
+            constexpr double kd = 1;
+            constexpr double extraKS = 3;
+            constexpr double sh = 4;
+
+            // Specular power is computed with two multiplications here and in span kernels
+            static_assert(sh == 4);
+
             Phong::Phong(AmbientLight ambientLight, DirectionalLight directionalLight)
                 :
                 m_ambient(ambientLight),
@@ -14,48 +22,58 @@ namespace ModelViewer
             {
             }
 
-            Color Phong::operator()(const Vec3<double>& normal, const Vec3<double>& worldVertex, 
-                const Vec3<double>& view, Color objectBaseColor, double ks) const
+            LightingState Phong::createLightingState(const Vec3<double>& viewPosition) const
             {
-                const Vec3<double> lightDirection = m_directional.direction.normalize();
+                LightingState lighting = {
+                    static_cast<Vec3<double>>(m_ambient.color) * (ka / Color::MAX),
+                    static_cast<Vec3<double>>(m_directional.color) * (kd / Color::MAX),
+                    static_cast<Vec3<double>>(m_directional.color) * (extraKS / Color::MAX),
+                    m_directional.direction.normalize(),
+                    viewPosition,
+                    {}
+                };
 
-                // TODO: remove hardcode viewPosition
-                const Vec3<double> viewPosition = { { 0.0, 0.0, -3.0 } };
-                const Vec3<double> viewDirection = (viewPosition - worldVertex).normalize();
+                for (int i = 0; i < 3; i++)
+                {
+                    lighting.span.ambient[i] = static_cast<float>(lighting.ambient[i]);
+                    lighting.span.diffuse[i] = static_cast<float>(lighting.diffuse[i]);
+                    lighting.span.specular[i] = static_cast<float>(lighting.specular[i]);
+                    lighting.span.lightDirection[i] = static_cast<float>(lighting.lightDirection[i]);
+                    lighting.span.viewPosition[i] = static_cast<float>(lighting.viewPosition[i]);
+                }
+
+                return lighting;
+            }
+
+            Color Phong::shade(const LightingState& lighting, const Vec3<double>& normal, const Vec3<double>& worldVertex,
+                Color objectBaseColor, double ks)
+            {
+                const Vec3<double>& lightDirection = lighting.lightDirection;
+                const Vec3<double> viewDirection = (lighting.viewPosition - worldVertex).normalize();
 
-                const double cosTheta = (std::max)(0.0, normal.cos(lightDirection));
+                const double cosTheta = (std::max)(0.0, lightDirection.dotProduct(normal) / normal.length());
 
-                constexpr double ka = 0.5;
-                constexpr double kd = 1;
-                constexpr double extraKS = 3;
-                constexpr double sh = 4;
-                
-                Vec3<double> ambient = static_cast<Vec3<double>>(m_ambient.color) * ka;
-                Vec3<double> diffuse = Vec3<double>{};
-                Vec3<double> specular = Vec3<double>{};
+                Vec3<double> fragmentLight = lighting.ambient;
 
                 if (cosTheta > 0)
                 {
                     Vec3<double> reflectionDirection = (lightDirection - normal * (lightDirection.dotProduct(normal)) * 2).normalize();
 
-                    diffuse = static_cast<Vec3<double>>(m_directional.color) * cosTheta * kd;
+                    const double cosAlpha = (std::max)(0.0, reflectionDirection.dotProduct(viewDirection));
+                    const double cosAlphaSquared = cosAlpha * cosAlpha;
 
-                    specular = static_cast<Vec3<double>>(m_directional.color) 
-                        * std::pow((std::max)(0.0, reflectionDirection.dotProduct(viewDirection)), sh) * ks * extraKS;
+                    fragmentLight += lighting.diffuse * cosTheta;
+                    fragmentLight += lighting.specular * (cosAlphaSquared * cosAlphaSquared * ks);
                 }
 
-                Vec3<double> fragmentColor = ((ambient + diffuse + specular) / Color::MAX).componentwiseMultiplication(
-                    static_cast<Vec3<double>>(objectBaseColor));
-                /*Vec3<double> fragmentColor = ((specular) / Color::MAX).componentwiseMultiplication(
-                    static_cast<Vec3<double>>(objectBaseColor));*/
+                Vec3<double> fragmentColor = fragmentLight.componentwiseMultiplication(static_cast<Vec3<double>>(objectBaseColor));
 
-                return { 
-                    Color::boundColorChannel(fragmentColor[0]), 
-                    Color::boundColorChannel(fragmentColor[1]), 
-                    Color::boundColorChannel(fragmentColor[2]) 
+                return {
+                    Color::boundColorChannel(fragmentColor[0]),
+                    Color::boundColorChannel(fragmentColor[1]),
+                    Color::boundColorChannel(fragmentColor[2])
                 };
-                //return objectBaseColor;
             }
         }
     }
-}
\ No newline at end of file
+}
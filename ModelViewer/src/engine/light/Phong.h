@@ -2,6 +2,7 @@
 #include "engine/Color.h"
 #include "math/Vector.h"
 #include "engine/Primitives.h"
+#include "engine/light/LightingState.h"
 
 namespace ModelViewer
 {
@@ -28,8 +29,9 @@ namespace ModelViewer
             {
             public:
                 Phong(AmbientLight ambientLight, DirectionalLight directionalLight);
-                Color operator()(const Vec3<double>& normal, const Vec3<double>& worldVertex, 
-                    const Vec3<double>& view, Color objectBaseColor, double ks = 1.0) const;
+                LightingState createLightingState(const Vec3<double>& viewPosition) const;
+                static Color shade(const LightingState& lighting, const Vec3<double>& normal, const Vec3<double>& worldVertex,
+                    Color objectBaseColor, double ks = 1.0);
 
             private:
                 AmbientLight m_ambient;
@@ -78,6 +78,17 @@ namespace ModelViewer
                 m_aspectRatio = ratio;
             }
 
+            Ray Camera::createRay(double x, double y) const
+            {
+                // The same axes as the view matrix
+                const auto zAxis = (m_position - m_target).normalize();
+                const auto xAxis = m_upVector.crossProduct(zAxis).normalize();
+                const auto yAxis = m_upVector.normalize();
+                const double tan = std::tan(m_fov / 2);
+
+                return { m_position, xAxis * (x * m_aspectRatio * tan) + yAxis * (y * tan) - zAxis };
+            }
+
             Matrix4<double> Camera::createViewMatrix(const Vector3<double>& position, const Vector3<double>& target, const Vector3<double>& upVector) const
             {
                 const auto zAxis = (position - target).normalizeSelf();
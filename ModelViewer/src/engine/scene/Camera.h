@@ -2,6 +2,7 @@
 #include "pch.h"
 #include "math/Vector.h"
 #include "math/Matrix.h"
+#include "engine/Ray.h"
 
 namespace ModelViewer
 {
@@ -21,6 +22,8 @@ namespace ModelViewer
                 Vector3<double> getTarget() const;
                 void changeUpVector(Vector3<double> upVector);
                 void setAspectRatio(double ratio);
+                // World space ray through a point of the view, x and y are from -1 to 1 with y up
+                Ray createRay(double x, double y) const;
 
             private:
                 Matrix4<double> createViewMatrix(const Vector3<double>& position, const Vector3<double>& target, const Vector3<double>& upVector) const;
@@ -0,0 +1,75 @@
+#include "pch.h"
+#include "Instance.h"
+#include "engine/WorldMatrix.h"
+
+namespace ModelViewer
+{
+    namespace Engine
+    {
+        namespace Scene
+        {
+            Instance::Instance(std::shared_ptr<const Object> object)
+                :
+                Instance(std::move(object), createIdentityMatrix<double, 4>())
+            {
+            }
+
+            Instance::Instance(std::shared_ptr<const Object> object, const Matrix4<double>& matrix)
+                :
+                m_object(std::move(object))
+            {
+                expect(m_object);
+
+                setMatrix(matrix);
+            }
+
+            const Object& Instance::getObject() const
+            {
+                return *m_object;
+            }
+
+            void Instance::setMatrix(const Matrix4<double>& matrix)
+            {
+                m_matrix = matrix;
+                // Translation doesn't reach the upper left 3x3 part that normals use
+                m_normalMatrix = matrix.inverse().transpose();
+                m_transformVersion++;
+            }
+
+            const Matrix4<double>& Instance::getMatrix() const
+            {
+                return m_matrix;
+            }
+
+            const Matrix4<double>& Instance::getNormalMatrix() const
+            {
+                return m_normalMatrix;
+            }
+
+            std::uint32_t Instance::getTransformVersion() const
+            {
+                return m_transformVersion;
+            }
+
+            void Instance::setMaterial(std::shared_ptr<const Textures> material)
+            {
+                m_material = std::move(material);
+            }
+
+            const DiffuseMap& Instance::getDiffuseMap() const
+            {
+                return m_material ? m_material->diffuseMap : m_object->getDiffuseMap();
+            }
+
+            const NormalMap& Instance::getNormalMap() const
+            {
+                return m_material ? m_material->normalMap : m_object->getNormalMap();
+            }
+
+            const SpecularMap& Instance::getSpecularMap() const
+            {
+                return m_material ? m_material->specularMap : m_object->getSpecularMap();
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "pch.h"
+#include "math/Matrix.h"
+#include "Object.h"
+
+namespace ModelViewer
+{
+    namespace Engine
+    {
+        namespace Scene
+        {
+            // Another placement of an object: the mesh and the maps stay with the object, an instance
+            // owns only its matrices and optionally a material shared with other instances
+            class Instance
+            {
+            public:
+                Instance(std::shared_ptr<const Object> object);
+                Instance(std::shared_ptr<const Object> object, const Matrix4<double>& matrix);
+                const Object& getObject() const;
+                void setMatrix(const Matrix4<double>& matrix);
+                const Matrix4<double>& getMatrix() const;
+                const Matrix4<double>& getNormalMatrix() const;
+                // Changes every time the matrices change
+                std::uint32_t getTransformVersion() const;
+                // Replaces the maps of the object, nullptr restores them
+                void setMaterial(std::shared_ptr<const Textures> material);
+                const DiffuseMap& getDiffuseMap() const;
+                const NormalMap& getNormalMap() const;
+                const SpecularMap& getSpecularMap() const;
+
+            private:
+                std::shared_ptr<const Object> m_object;
+                std::shared_ptr<const Textures> m_material;
+                Matrix4<double> m_matrix;
+                Matrix4<double> m_normalMatrix;
+                std::uint32_t m_transformVersion = 0;
+            };
+        }
+    }
+}
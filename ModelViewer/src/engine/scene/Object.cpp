@@ -8,14 +8,9 @@ namespace ModelViewer
     {
         namespace Scene
         {
-            Object::Object(std::vector<Vec4<double>> vertices, std::vector<Vec3<double>> normals, 
-                std::vector<Vec3<double>> textureCoords, std::vector<Index> indices, 
-                std::vector<Color> colors, ColorType colorType)
+            Object::Object(Mesh mesh, std::vector<Color> colors, ColorType colorType)
                 :
-                m_Vertices(vertices),
-                m_textureVertices(textureCoords),
-                m_normals(normals),
-                m_Indices(indices),
+                m_mesh(std::move(mesh)),
                 m_colors(colors),
                 m_colorType(colorType),
                 m_TranslateVector({0,0,0}),
@@ -24,26 +19,51 @@ namespace ModelViewer
                 m_CacheModelMatrix(createModelMatrix(m_TranslateVector, m_RotateVector, m_ScaleVector)),
                 m_CacheNormalModelMatrix(m_CacheModelMatrix.inverse().transpose())
             {
+                m_bounds = BoundingBox::empty();
+                for (const MeshCluster& cluster : m_mesh.clusters)
+                    m_bounds.extend(cluster.bounds);
+
+                std::vector<BoundingBox> clusterBounds;
+                clusterBounds.reserve(m_mesh.clusters.size());
+                for (const MeshCluster& cluster : m_mesh.clusters)
+                    clusterBounds.push_back(cluster.bounds);
+
+                m_clusterTree.build(clusterBounds);
+            }
+
+            ArrayView<Vector4<double>> Object::getVertices() const
+            {
+                return m_mesh.vertices;
+            }
+
+            ArrayView<Vec3<double>> Object::getTextureVertices() const
+            {
+                return m_mesh.textureVertices;
+            }
+
+            ArrayView<Vec3<double>> Object::getNormals() const
+            {
+                return m_mesh.normals;
             }
 
-            const std::vector<Vector4<double>>& Object::getVertices() const
+            ArrayView<VertexIndex> Object::getIndices() const
             {
-                return m_Vertices;
+                return m_mesh.indices;
             }
 
-            const std::vector<Vec3<double>>& Object::getTextureVertices() const
+            ArrayView<MeshCluster> Object::getClusters() const
             {
-                return m_textureVertices;
+                return m_mesh.clusters;
             }
 
-            const std::vector<Vec3<double>>& Object::getNormals() const
+            const BoundingBox& Object::getBounds() const
             {
-                return m_normals;
+                return m_bounds;
             }
 
-            const std::vector<Index>& Object::getIndices() const
+            const Bvh& Object::getClusterTree() const
             {
-                return m_Indices;
+                return m_clusterTree;
             }
 
             const std::vector<Color>& Object::getColors() const
@@ -68,6 +88,11 @@ namespace ModelViewer
                 return m_CacheNormalModelMatrix;
             }
 
+            std::uint32_t Object::getTransformVersion() const
+            {
+                return m_transformVersion;
+            }
+
             void Object::scaleX(double amount)
             {
                 m_ScaleVector[0] = amount;
@@ -193,6 +218,7 @@ namespace ModelViewer
             {
                 m_CacheModelMatrix = createModelMatrix(m_TranslateVector, m_RotateVector, m_ScaleVector);
                 m_CacheNormalModelMatrix = createModelMatrix(Vec4<double>{ {0, 0, 0} }, m_RotateVector, m_ScaleVector).inverse().transpose();
+                m_transformVersion++;
             }
         }
     }
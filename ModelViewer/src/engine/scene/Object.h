@@ -3,6 +3,8 @@
 #include "math/Vector.h"
 #include "math/Matrix.h"
 #include "engine/ObjectParser.h"
+#include "engine/Mesh.h"
+#include "engine/Bvh.h"
 #include "engine/Color.h"
 #include "engine/DiffuseMap.h"
 #include "engine/NormalMap.h"
@@ -14,6 +16,13 @@ namespace ModelViewer
     {
         namespace Scene
         {
+            struct Textures
+            {
+                DiffuseMap diffuseMap;
+                NormalMap normalMap;
+                SpecularMap specularMap;
+            };
+
             class Object
             {
             public:
@@ -26,17 +35,22 @@ namespace ModelViewer
                 };
 
             public:
-                Object(std::vector<Vector4<double>> vertices, std::vector<Vec3<double>> textureCoords, 
-                    std::vector<Vec3<double>> normals, std::vector<Index> indices, 
-                    std::vector<Color> colors = { {0xFF, 0xFF, 0xFF} }, ColorType colorType = ColorType::SOLID);
-                const std::vector<Vector4<double>>& getVertices() const;
-                const std::vector<Vec3<double>>& getTextureVertices() const;
-                const std::vector<Vec3<double>>& getNormals() const;
-                const std::vector<Index>& getIndices() const;
+                Object(Mesh mesh, std::vector<Color> colors = { {0xFF, 0xFF, 0xFF} }, ColorType colorType = ColorType::SOLID);
+                ArrayView<Vector4<double>> getVertices() const;
+                ArrayView<Vec3<double>> getTextureVertices() const;
+                ArrayView<Vec3<double>> getNormals() const;
+                ArrayView<VertexIndex> getIndices() const;
+                ArrayView<MeshCluster> getClusters() const;
+                // Bounds of all clusters in object space
+                const BoundingBox& getBounds() const;
+                // Hierarchy over the clusters in object space
+                const Bvh& getClusterTree() const;
                 const std::vector<Color>& getColors() const;
                 void setColor(Color color);
                 const Matrix4<double>& getMatrix() const;
                 const Matrix4<double>& getNormalMatrix() const;
+                // Changes every time the matrices change
+                std::uint32_t getTransformVersion() const;
                 void scaleX(double amount);
                 void scaleY(double amount);
                 void scaleZ(double amount);
@@ -62,10 +76,9 @@ namespace ModelViewer
                 void updateCachedModelMatrices();
 
             private:
-                std::vector<Vector4<double>> m_Vertices;
-                std::vector<Vec3<double>> m_textureVertices;
-                std::vector<Vec3<double>> m_normals;
-                std::vector<Index> m_Indices;
+                Mesh m_mesh;
+                BoundingBox m_bounds;
+                Bvh m_clusterTree;
                 std::vector<Color> m_colors;
                 ColorType m_colorType;
 
@@ -74,12 +87,9 @@ namespace ModelViewer
                 Vector4<double> m_ScaleVector;
                 Matrix4<double> m_CacheModelMatrix;
                 Matrix4<double> m_CacheNormalModelMatrix;
+                std::uint32_t m_transformVersion = 0;
 
-                struct {
-                    DiffuseMap diffuseMap;
-                    NormalMap normalMap;
-                    SpecularMap specularMap;
-                } m_textures;
+                Textures m_textures;
             };
         }
     }
@@ -2,6 +2,7 @@
 #include "Scene.h"
 #include "Core.h"
 #include "engine/Primitives.h"
+#include "engine/Frustum.h"
 
 namespace ModelViewer
 {
@@ -10,6 +11,9 @@ namespace ModelViewer
         namespace Scene
         {
             Scene::Scene()
+                :
+                // TODO: calculate light
+                m_light({ { 99, 179, 219  }, 50 }, { Vector3<double>({ 0, 0, 5.0 }), { 145, 155, 237}, 50 })
             {
             }
 
@@ -27,28 +31,101 @@ namespace ModelViewer
                 expect(object);
 
                 m_Objects.push_back(object);
+                addPacket(*object, nullptr);
+            }
+
+            void Scene::addInstance(const std::shared_ptr<Instance>& instance)
+            {
+                expect(instance);
 
-                m_vertices.reserve(object->getVertices().size());
-                m_verticesWorld.reserve(object->getVertices().size());
-                m_indices.reserve(object->getIndices().size());
-
-                /*m_diffuseMap = {};
-                m_diffuseMap.data.reserve(object->getDiffuseMap().data.size());
-                m_diffuseMap.width = object->getDiffuseMap().width;
-                m_diffuseMap.height = object->getDiffuseMap().height;*/
-                m_diffuseMap = object->getDiffuseMap();
-
-                m_normalMap = {};
-                m_normalMap.data.reserve(object->getNormalMap().data.size());
-                m_normalMap.data.resize(object->getNormalMap().data.size());
-                m_normalMap.width = object->getNormalMap().width;
-                m_normalMap.height = object->getNormalMap().height;
-
-                /*m_specularMap = {};
-                m_specularMap.data.reserve(object->getSpecularMap().data.size());
-                m_specularMap.width = object->getSpecularMap().width;
-                m_specularMap.height = object->getSpecularMap().height;*/
-                m_specularMap = object->getSpecularMap();
+                m_Instances.push_back(instance);
+                addPacket(instance->getObject(), instance.get());
+            }
+
+            void Scene::addPacket(const Object& object, const Instance* instance)
+            {
+                // Vertex ranges are laid out every frame, see render
+                DrawPacket packet = {};
+                packet.vertexCount = object.getVertices().size();
+                packet.firstIndex = m_indicesCount;
+                packet.indexCount = object.getIndices().size();
+
+                m_indicesCount += packet.indexCount;
+                m_packets.push_back(packet);
+                m_packetSources.push_back({ &object, instance, 0 });
+                m_packetBounds.push_back(BoundingBox::empty());
+                m_shouldBuildPacketTree = true;
+            }
+
+            void Scene::updatePacketTree()
+            {
+                bool moved = false;
+
+                for (std::size_t i = 0; i < m_packetSources.size(); i++)
+                {
+                    PacketSource& source = m_packetSources[i];
+                    const std::uint32_t version = source.instance ? source.instance->getTransformVersion() : source.object->getTransformVersion();
+
+                    if (version == source.transformVersion && !m_shouldBuildPacketTree)
+                        continue;
+
+                    const Matrix4<double>& matrix = source.instance ? source.instance->getMatrix() : source.object->getMatrix();
+                    m_packetBounds[i] = source.object->getBounds().transform(matrix);
+                    source.transformVersion = version;
+                    moved = true;
+                }
+
+                if (m_shouldBuildPacketTree)
+                {
+                    m_packetTree.build(m_packetBounds);
+                    m_shouldBuildPacketTree = false;
+                }
+                else if (moved)
+                {
+                    m_packetTree.refit(m_packetBounds);
+                }
+            }
+
+            void Scene::transformVisibleVertices(const DrawPacket& packet, ArrayView<Vector4<double>> vertices, const Matrix4<double>& screen)
+            {
+                // Vertex ranges of neighbouring clusters mostly follow each other, see MeshOptimizer::buildClusters
+                std::size_t begin = 0;
+                std::size_t end = 0;
+
+                const auto transformRange = [&]()
+                {
+                    // Model, view, projection and viewport matrices at once, 8 vertices at a time
+                    if (begin < end)
+                        m_vertices.transform(screen, packet.modelMatrix, { vertices.data() + begin, end - begin }, packet.firstVertex + begin);
+                };
+
+                for (const std::uint32_t i : packet.visibleClusters)
+                {
+                    const MeshCluster& cluster = packet.clusters[i];
+
+                    // Ranges start at whole batches for the aligned stores of the kernels
+                    const std::size_t first = cluster.firstVertex / VERTEX_BATCH * VERTEX_BATCH;
+                    const std::size_t last = static_cast<std::size_t>(cluster.firstVertex) + cluster.verticesCount;
+
+                    if (begin == end || first > end)
+                    {
+                        transformRange();
+                        begin = first;
+                        end = last;
+                    }
+                    else
+                    {
+                        begin = (std::min)(begin, first);
+                        end = (std::max)(end, last);
+                    }
+                }
+
+                transformRange();
+            }
+
+            const std::shared_ptr<Camera>& Scene::getActiveCamera() const
+            {
+                return m_CurrentActiveCamera;
             }
 
             RenderResult Scene::render(Viewport& vp)
@@ -59,72 +136,139 @@ namespace ModelViewer
                 m_verticesWorld.clear();
                 m_indices.clear();*/
 
-                const auto vpv = vp.getMatrix() 
-                    * m_CurrentActiveCamera->getProjectionMatrix() 
-                    * m_CurrentActiveCamera->getViewMatrix();
+                const auto pv = m_CurrentActiveCamera->getProjectionMatrix() * m_CurrentActiveCamera->getViewMatrix();
+                const auto vpv = vp.getMatrix() * pv;
                 const auto& v = m_CurrentActiveCamera->getViewMatrix();
 
-                for (const auto& object : m_Objects)
-                {
-                    const auto& objVertices = object->getVertices();
-                    const auto& objTextureVertices = object->getTextureVertices();
-                    const auto& objIndices = object->getIndices();
-                    const auto& objNormalMap = object->getNormalMap();
+                m_lighting = m_light.createLightingState(m_CurrentActiveCamera->getPosition());
 
-                    m_vertices.resize(objVertices.size());
-                    m_verticesWorld.resize(objVertices.size());
-                    m_textureVertices.resize(objTextureVertices.size());
-                    m_indices.resize(objIndices.size());
+                updatePacketTree();
 
-                    const auto& m = object->getMatrix();
-                    const Mat3<double> mNormal = static_cast<Mat3<double>>(object->getNormalMatrix());
+                for (DrawPacket& packet : m_packets)
+                    packet.visibleClusters.clear();
 
-                    // Copy vertices
-                    for (std::size_t i = 0; i < objVertices.size(); i++)
-                        m_vertices[i] = objVertices[i];
-
-                    // Copy normals
-                    for (std::size_t i = 0; i < objNormalMap.data.size(); i++)
-                        m_normalMap.data[i] = objNormalMap.data[i];
+                // Placement is the object itself or an instance of it, both provide matrices and maps
+                const auto updatePacket = [&pv, &vpv](DrawPacket& packet, const Object& object, const auto& placement,
+                    Frustum::Containment containment)
+                {
+                    // Transforms and maps may change between frames, mesh data may not
+                    packet.modelMatrix = placement.getMatrix();
+                    packet.screenMatrix = vpv * packet.modelMatrix;
+                    packet.normalMatrix = static_cast<Mat3<double>>(placement.getNormalMatrix());
+                    packet.uvs = object.getTextureVertices();
+                    packet.indices = object.getIndices();
+                    packet.clusters = object.getClusters();
+                    packet.clusterTree = &object.getClusterTree();
+                    packet.material = { &placement.getDiffuseMap(), &placement.getNormalMap(), &placement.getSpecularMap() };
 
-                    // Copy indices
-                    for (std::size_t i = 0; i < objIndices.size(); i++)
-                        m_indices[i] = objIndices[i];
+                    // The world space box of the packet is looser than the object space one
+                    const Frustum frustum(pv * packet.modelMatrix);
+                    if (containment == Frustum::Containment::INTERSECTS)
+                        containment = frustum.test(object.getBounds());
 
-                    // Copy texture vertices (UVs)
-                    for (std::size_t i = 0; i < objTextureVertices.size(); i++)
-                        m_textureVertices[i] = objTextureVertices[i];
+                    if (containment == Frustum::Containment::OUTSIDE)
+                        return;
 
-                    // Model matrix applying
-                    for (std::size_t i = 0; i < m_vertices.size(); i++)
+                    if (containment == Frustum::Containment::INSIDE)
                     {
-                        m_vertices[i] = m * m_vertices[i];
-                        m_verticesWorld[i] = m_vertices[i];
+                        packet.visibleClusters.resize(packet.clusters.size());
+                        std::iota(packet.visibleClusters.begin(), packet.visibleClusters.end(), 0);
                     }
-
-                    // Model matrix applying for normals
-                    for (std::size_t i = 0; i < m_normalMap.data.size(); i++)
-                        m_normalMap.data[i] = mNormal * m_normalMap.data[i];
-
-                    // View Projective Viewport matrix applying and dividing by W
-                    for (std::size_t i = 0; i < m_vertices.size(); i++)
+                    else
                     {
-                        m_vertices[i] = vpv * m_vertices[i];
-                        m_vertices[i][X] /= m_vertices[i][W];
-                        m_vertices[i][Y] /= m_vertices[i][W];
+                        object.getClusterTree().query(frustum, [&](std::uint32_t i, Frustum::Containment clusterContainment)
+                        {
+                            if (clusterContainment == Frustum::Containment::INSIDE || frustum.test(packet.clusters[i].bounds) != Frustum::Containment::OUTSIDE)
+                                packet.visibleClusters.push_back(i);
+                        });
+
+                        // Leaves of the tree are in no particular order
+                        std::sort(packet.visibleClusters.begin(), packet.visibleClusters.end());
                     }
+                };
+
+                // Objects and clusters out of the view are dropped before any vertex work
+                m_packetTree.query(Frustum(pv), [&](std::uint32_t i, Frustum::Containment containment)
+                {
+                    const PacketSource& source = m_packetSources[i];
+
+                    if (source.instance)
+                        updatePacket(m_packets[i], *source.object, *source.instance, containment);
+                    else
+                        updatePacket(m_packets[i], *source.object, *source.object, containment);
+                });
+
+                // Packets in the view are packed at the front of the buffer, every one starting at a whole vertex batch
+                std::size_t verticesCount = 0;
+                for (DrawPacket& packet : m_packets)
+                {
+                    if (packet.visibleClusters.empty())
+                        continue;
+
+                    packet.firstVertex = (verticesCount + VERTEX_BATCH - 1) / VERTEX_BATCH * VERTEX_BATCH;
+                    verticesCount = packet.firstVertex + packet.vertexCount;
+                }
+
+                // Memory follows the packets in the view rather than all instances, and is kept when fewer are visible
+                m_vertices.resize(verticesCount);
+
+                // Instances read the same source vertices and write their own range
+                for (std::size_t i = 0; i < m_packets.size(); i++)
+                {
+                    if (!m_packets[i].visibleClusters.empty())
+                        transformVisibleVertices(m_packets[i], m_packetSources[i].object->getVertices(), m_packets[i].screenMatrix);
                 }
 
                 return {
-                    std::cref(m_vertices), 
-                    std::cref(m_verticesWorld),
-                    std::cref(m_textureVertices),
-                    std::cref(m_indices),
-                    m_diffuseMap,
-                    m_normalMap,
-                    m_specularMap
+                    std::cref(m_vertices),
+                    std::cref(m_packets),
+                    m_indicesCount,
+                    m_lighting,
+                    vpv
                 };
             }
+
+            std::optional<PickResult> Scene::pick(const Ray& ray)
+            {
+                updatePacketTree();
+
+                std::optional<PickResult> result;
+
+                m_packetTree.intersect(ray, std::numeric_limits<double>::infinity(), [&](std::uint32_t i, double closest)
+                {
+                    const PacketSource& source = m_packetSources[i];
+                    const Object& object = *source.object;
+                    const Matrix4<double>& matrix = source.instance ? source.instance->getMatrix() : object.getMatrix();
+
+                    // Distances along the object space ray are the same as along the world space one
+                    const Ray objectRay = ray.transform(matrix.inverse());
+                    const ArrayView<Vector4<double>> vertices = object.getVertices();
+                    const ArrayView<VertexIndex> indices = object.getIndices();
+
+                    return object.getClusterTree().intersect(objectRay, closest, [&](std::uint32_t clusterIndex, double closestInCluster)
+                    {
+                        const MeshCluster& cluster = object.getClusters()[clusterIndex];
+
+                        for (std::size_t triangle = cluster.firstTriangle; triangle < cluster.firstTriangle + cluster.trianglesCount; triangle++)
+                        {
+                            const double distance = objectRay.intersect(
+                                static_cast<Vec3<double>>(vertices[indices[3 * triangle]]),
+                                static_cast<Vec3<double>>(vertices[indices[3 * triangle + 1]]),
+                                static_cast<Vec3<double>>(vertices[indices[3 * triangle + 2]]));
+
+                            if (distance < closestInCluster)
+                            {
+                                closestInCluster = distance;
+                                result = PickResult{ &object, source.instance, triangle, distance };
+                            }
+                        }
+
+                        return closestInCluster;
+                    });
+                });
+
+                return result;
+            }
         }
     }
 }
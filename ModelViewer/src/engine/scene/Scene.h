@@ -1,9 +1,14 @@
 #pragma once
 #include "Object.h"
+#include "Instance.h"
 #include "Camera.h"
 #include "engine/Viewport.h"
 #include "engine/Rasterizer.h"
+#include "engine/TransformedVertices.h"
+#include "engine/Bvh.h"
+#include "engine/Ray.h"
 #include "engine/light/Lambert.h"
+#include "engine/light/Phong.h"
 #include "engine/DiffuseMap.h"
 #include "engine/NormalMap.h"
 #include "engine/SpecularMap.h"
@@ -14,15 +19,54 @@ namespace ModelViewer
     {
         namespace Scene
         {
+            struct Material
+            {
+                const DiffuseMap* diffuseMap;
+                const NormalMap* normalMap;
+                const SpecularMap* specularMap;
+            };
+
+            // Everything needed to draw one object. Vertex ranges are in the transformed vertices of the frame,
+            // given only to packets in the view, index ranges in the scene wide index space, where packets follow each other.
+            struct DrawPacket
+            {
+                Matrix4<double> modelMatrix;
+                // Model to screen space, for bounds of clusters
+                Matrix4<double> screenMatrix;
+                // Object to world space for normal map texels
+                Matrix3<double> normalMatrix;
+                std::size_t firstVertex;
+                std::size_t vertexCount;
+                std::size_t firstIndex;
+                std::size_t indexCount;
+                // Object data used in place, indices refer to the object's own vertices
+                ArrayView<Vec3<double>> uvs;
+                ArrayView<VertexIndex> indices;
+                ArrayView<MeshCluster> clusters;
+                const Bvh* clusterTree;
+                Material material;
+                // Clusters in the view frustum in ascending order, only their vertices are transformed
+                std::vector<std::uint32_t> visibleClusters;
+            };
+
             struct RenderResult
             {
-                std::reference_wrapper<const std::vector<Vec4<double>>> ver;
-                std::reference_wrapper<const std::vector<Vec4<double>>> verticesWorld;
-                std::reference_wrapper<const std::vector<Vec3<double>>> uv;
-                std::reference_wrapper<const std::vector<Index>> ind;
-                const DiffuseMap& diffuseMap;
-                const NormalMap& normalMap;
-                const SpecularMap& specularMap;
+                std::reference_wrapper<const TransformedVertices> vertices;
+                std::reference_wrapper<const std::vector<DrawPacket>> packets;
+                std::size_t indicesCount;
+                const Light::LightingState& lighting;
+                // World to screen space
+                Matrix4<double> screenMatrix;
+            };
+
+            struct PickResult
+            {
+                const Object* object;
+                // nullptr when the object itself was hit
+                const Instance* instance;
+                std::size_t triangle;
+                // Along the ray, in lengths of its direction
+                double distance;
             };
 
             class Scene
@@ -31,20 +75,43 @@ namespace ModelViewer
                 Scene();
                 void addCamera(const std::shared_ptr<Camera>& camera);
                 void addObject(const std::shared_ptr<Object>& object);
+                // Draws the object of the instance once more, the object doesn't have to be added itself
+                void addInstance(const std::shared_ptr<Instance>& instance);
+                const std::shared_ptr<Camera>& getActiveCamera() const;
                 RenderResult render(Viewport& vp);
+                // Closest triangle hit by a world space ray, see Camera::createRay
+                std::optional<PickResult> pick(const Ray& ray);
 
             private:
                 std::vector<std::shared_ptr<Camera>> m_Cameras;
                 std::shared_ptr<Camera> m_CurrentActiveCamera;
                 std::vector<std::shared_ptr<Object>> m_Objects;
+                std::vector<std::shared_ptr<Instance>> m_Instances;
+
+                // What every packet draws, instance is nullptr for objects drawn on their own
+                struct PacketSource
+                {
+                    const Object* object;
+                    const Instance* instance;
+                    // Of the matrix the world space bounds were computed with
+                    std::uint32_t transformVersion;
+                };
+
+                void addPacket(const Object& object, const Instance* instance);
+                // Refits the hierarchy over world space bounds of the packets to moved objects and instances
+                void updatePacketTree();
+                void transformVisibleVertices(const DrawPacket& packet, ArrayView<Vector4<double>> vertices, const Matrix4<double>& screen);
 
-                std::vector<Vector4<double>> m_vertices;
-                std::vector<Vector4<double>> m_verticesWorld;
-                std::vector<Vec3<double>> m_textureVertices;
-                std::vector<Index> m_indices;
-                DiffuseMap m_diffuseMap;
-                NormalMap m_normalMap;
-                SpecularMap m_specularMap;
+                // Buffers for the whole scene reused every frame. Transformed vertices are sized for the packets in the view.
+                std::vector<DrawPacket> m_packets;
+                std::vector<PacketSource> m_packetSources;
+                std::size_t m_indicesCount = 0;
+                std::vector<BoundingBox> m_packetBounds;
+                Bvh m_packetTree;
+                bool m_shouldBuildPacketTree = false;
+                TransformedVertices m_vertices;
+                Light::Phong m_light;
+                Light::LightingState m_lighting;
             };
         }
     }
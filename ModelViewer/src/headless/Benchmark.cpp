@@ -0,0 +1,118 @@
+#include "pch.h"
+#include "Benchmark.h"
+
+namespace ModelViewer::Headless
+{
+    Benchmark::Benchmark(BenchmarkSetup setup)
+        :
+        m_setup(std::move(setup))
+    {
+    }
+
+    void Benchmark::addFrame(const Engine::FrameStats& stats)
+    {
+        m_frames.push_back(stats);
+    }
+
+    void Benchmark::writeJson(std::ostream& out) const
+    {
+        Engine::StageDuration totalTime = {};
+        std::size_t trianglesSubmitted = 0;
+        std::size_t trianglesInFrustum = 0;
+        std::size_t trianglesOccluded = 0;
+        std::size_t trianglesRasterized = 0;
+        std::size_t pixelsShaded = 0;
+
+        for (const auto& frame : m_frames)
+        {
+            totalTime += getFrameTime(frame);
+            trianglesSubmitted += frame.trianglesSubmitted;
+            trianglesInFrustum += frame.trianglesInFrustum;
+            trianglesOccluded += frame.trianglesOccluded;
+            trianglesRasterized += frame.trianglesRasterized;
+            pixelsShaded += frame.pixelsShaded;
+        }
+
+        const double seconds = totalTime.count() / 1000;
+        const double frames = static_cast<double>((std::max)(m_frames.size(), std::size_t(1)));
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\n";
+        out << "  \"model\": \"" << escape(m_setup.model) << "\",\n";
+        out << "  \"width\": " << m_setup.width << ",\n";
+        out << "  \"height\": " << m_setup.height << ",\n";
+        out << "  \"kernel\": \"" << m_setup.kernel << "\",\n";
+        out << "  \"threads\": " << m_setup.threads << ",\n";
+        out << "  \"instances\": " << m_setup.instances << ",\n";
+        out << "  \"occlusion_culling\": " << (m_setup.occlusionCulling ? "true" : "false") << ",\n";
+        out << "  \"depth_prepass\": " << (m_setup.depthPrePass ? "true" : "false") << ",\n";
+        out << "  \"shading\": \"" << m_setup.shading << "\",\n";
+        out << "  \"depth_format\": \"" << m_setup.depthFormat << "\",\n";
+        out << "  \"msaa\": " << (m_setup.multisampling ? "true" : "false") << ",\n";
+        out << "  \"frames\": " << m_frames.size() << ",\n";
+        out << "  \"stages_ms\": {\n";
+        writeStage(out, "transform", &Engine::FrameStats::transform);
+        out << ",\n";
+        writeStage(out, "clear", &Engine::FrameStats::clear);
+        out << ",\n";
+        writeStage(out, "culling", &Engine::FrameStats::culling);
+        out << ",\n";
+        writeStage(out, "rasterization", &Engine::FrameStats::rasterization);
+        out << ",\n";
+        writeStage(out, "shading", &Engine::FrameStats::shading);
+        out << ",\n";
+        writeStage(out, "present", &Engine::FrameStats::present);
+        out << ",\n";
+        writeStage(out, "frame", nullptr);
+        out << "\n  },\n";
+        out << "  \"triangles_per_frame\": " << trianglesSubmitted / frames << ",\n";
+        out << "  \"triangles_in_frustum_per_frame\": " << trianglesInFrustum / frames << ",\n";
+        out << "  \"occluded_triangles_per_frame\": " << trianglesOccluded / frames << ",\n";
+        out << "  \"rasterized_triangles_per_frame\": " << trianglesRasterized / frames << ",\n";
+        out << "  \"shaded_pixels_per_frame\": " << pixelsShaded / frames << ",\n";
+        out << "  \"frames_per_second\": " << (seconds > 0 ? m_frames.size() / seconds : 0) << ",\n";
+        out << "  \"triangles_per_second\": " << (seconds > 0 ? trianglesSubmitted / seconds : 0) << ",\n";
+        out << "  \"pixels_per_second\": " << (seconds > 0 ? pixelsShaded / seconds : 0) << "\n";
+        out << "}\n";
+    }
+
+    // Whole frame when stage is null
+    void Benchmark::writeStage(std::ostream& out, const char* name, Engine::StageDuration Engine::FrameStats::* stage) const
+    {
+        std::vector<double> times;
+        times.reserve(m_frames.size());
+
+        for (const auto& frame : m_frames)
+            times.push_back((stage ? frame.*stage : getFrameTime(frame)).count());
+
+        std::sort(times.begin(), times.end());
+
+        const double mean = times.empty() ? 0 : std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+        const double min = times.empty() ? 0 : times.front();
+        const double median = times.empty() ? 0 : times[times.size() / 2];
+        const double max = times.empty() ? 0 : times.back();
+
+        out << "    \"" << name << "\": { \"mean\": " << mean << ", \"min\": " << min
+            << ", \"median\": " << median << ", \"max\": " << max << " }";
+    }
+
+    Engine::StageDuration Benchmark::getFrameTime(const Engine::FrameStats& stats)
+    {
+        return stats.transform + stats.clear + stats.culling + stats.rasterization + stats.shading + stats.present;
+    }
+
+    std::string Benchmark::escape(const std::string& str)
+    {
+        std::string out;
+
+        for (const char c : str)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+
+            out += c;
+        }
+
+        return out;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "pch.h"
+#include "engine/FrameStats.h"
+
+namespace ModelViewer::Headless
+{
+    struct BenchmarkSetup
+    {
+        std::string model;
+        int width;
+        int height;
+        std::string kernel;
+        unsigned threads;
+        int instances;
+        bool occlusionCulling;
+        bool depthPrePass;
+        std::string shading;
+        std::string depthFormat;
+        bool multisampling;
+    };
+
+    // Collects stats of rendered frames and reports them as JSON, so runs of different builds can be diffed
+    class Benchmark
+    {
+    public:
+        Benchmark(BenchmarkSetup setup);
+        void addFrame(const Engine::FrameStats& stats);
+        void writeJson(std::ostream& out) const;
+
+    private:
+        void writeStage(std::ostream& out, const char* name, Engine::StageDuration Engine::FrameStats::* stage) const;
+        static Engine::StageDuration getFrameTime(const Engine::FrameStats& stats);
+        static std::string escape(const std::string& str);
+
+    private:
+        BenchmarkSetup m_setup;
+        std::vector<Engine::FrameStats> m_frames;
+    };
+}
@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "ImageWriter.h"
+#include "lodepng/lodepng.h"
+
+namespace ModelViewer::Headless
+{
+    ImageWriter::ImageWriter(ImageFormat format)
+        :
+        m_format(format)
+    {
+    }
+
+    void ImageWriter::write(const Engine::FrameBuffer& frameBuffer, const std::filesystem::path& filename) const
+    {
+        if (m_format == ImageFormat::PNG)
+            writePng(frameBuffer, filename);
+        else
+            writePpm(frameBuffer, filename);
+    }
+
+    const char* ImageWriter::getExtension() const
+    {
+        return m_format == ImageFormat::PNG ? ".png" : ".ppm";
+    }
+
+    void ImageWriter::writePng(const Engine::FrameBuffer& frameBuffer, const std::filesystem::path& filename) const
+    {
+        const std::vector<Engine::ColorChannel> pixels = frameBuffer.readRGB();
+        unsigned err = lodepng::encode(filename.string(), pixels, frameBuffer.getWidth(), frameBuffer.getHeight(), LCT_RGB);
+
+        if (err)
+        {
+            std::stringstream ss;
+            ss << "encode error " << err << ": " << lodepng_error_text(err);
+
+            throw std::runtime_error(ss.str().c_str());
+        }
+    }
+
+    void ImageWriter::writePpm(const Engine::FrameBuffer& frameBuffer, const std::filesystem::path& filename) const
+    {
+        const std::vector<Engine::ColorChannel> pixels = frameBuffer.readRGB();
+        std::ofstream out(filename, std::ios::binary);
+
+        out << "P6\n" << frameBuffer.getWidth() << ' ' << frameBuffer.getHeight() << "\n255\n";
+        out.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+
+        if (!out)
+            throw std::runtime_error("could not write " + filename.string());
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "pch.h"
+#include "engine/FrameBuffer.h"
+
+namespace ModelViewer::Headless
+{
+    enum class ImageFormat
+    {
+        PNG,
+        PPM
+    };
+
+    class ImageWriter
+    {
+    public:
+        ImageWriter(ImageFormat format);
+        void write(const Engine::FrameBuffer& frameBuffer, const std::filesystem::path& filename) const;
+        const char* getExtension() const;
+
+    private:
+        void writePng(const Engine::FrameBuffer& frameBuffer, const std::filesystem::path& filename) const;
+        void writePpm(const Engine::FrameBuffer& frameBuffer, const std::filesystem::path& filename) const;
+
+    private:
+        ImageFormat m_format;
+    };
+}
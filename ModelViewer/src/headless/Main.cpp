@@ -0,0 +1,331 @@
+#include "pch.h"
+#include "ImageWriter.h"
+#include "Benchmark.h"
+#include "engine/Renderer.h"
+#include "engine/SpanKernel.h"
+#include "engine/Viewport.h"
+#include "engine/WorldMatrix.h"
+#include "engine/MeshCache.h"
+#include "engine/TextureParser.h"
+#include "engine/scene/Scene.h"
+#include "engine/scene/Object.h"
+#include "engine/scene/Instance.h"
+#include "engine/scene/Camera.h"
+
+#include <iostream>
+#include <iomanip>
+
+// Renders a model without a window: the camera orbits the model and every frame is written to an image file.
+// In benchmark mode nothing is written, per stage timings of the frames are reported as JSON instead.
+// With --check every frame is rendered once more with forward shading, rendering fails if a channel of
+// the two differs by more than CHECK_TOLERANCE.
+//
+// ModelViewerHeadless <model.obj> [--diffuse file.png] [--normal file.png] [--specular file.png]
+//     [--width 1280] [--height 720] [--frames 1] [--output frame] [--format png|ppm]
+//     [--instances 1] [--occlusion on|off] [--prepass on|off] [--shading forward|deferred|visibility]
+//     [--depth double|float] [--msaa on|off] [--check] [--benchmark] [--json report.json]
+
+namespace
+{
+    using namespace ModelViewer;
+
+    constexpr double PI = 3.14159265358979323846;
+    constexpr double CAMERA_DISTANCE = 3.0;
+
+    // Deferred shading keeps the specular coefficient in 8 bits and rebuilds the world position from depth
+    constexpr int CHECK_TOLERANCE = 1;
+
+    struct Options
+    {
+        std::string model;
+        std::string diffuseMap;
+        std::string normalMap;
+        std::string specularMap;
+        int width = 1280;
+        int height = 720;
+        int frames = 1;
+        int instances = 1;
+        bool occlusionCulling = true;
+        bool depthPrePass = false;
+        Engine::ShadingMode shading = Engine::ShadingMode::FORWARD;
+        Engine::DepthFormat depthFormat = Engine::DepthFormat::FLOAT64;
+        bool multisampling = false;
+        bool check = false;
+        std::string output = "frame";
+        Headless::ImageFormat format = Headless::ImageFormat::PNG;
+        bool benchmark = false;
+        std::string json;
+    };
+
+    Options parseOptions(int argc, char** argv)
+    {
+        Options options;
+
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string_view arg = argv[i];
+
+            if (arg.substr(0, 2) != "--")
+            {
+                options.model = arg;
+                continue;
+            }
+
+            if (arg == "--benchmark")
+            {
+                options.benchmark = true;
+                continue;
+            }
+
+            if (arg == "--check")
+            {
+                options.check = true;
+                continue;
+            }
+
+            if (i + 1 == argc)
+                throw std::runtime_error("missing value for " + std::string(arg));
+
+            const std::string value = argv[++i];
+
+            if (arg == "--diffuse")
+                options.diffuseMap = value;
+            else if (arg == "--normal")
+                options.normalMap = value;
+            else if (arg == "--specular")
+                options.specularMap = value;
+            else if (arg == "--width")
+                options.width = std::stoi(value);
+            else if (arg == "--height")
+                options.height = std::stoi(value);
+            else if (arg == "--frames")
+                options.frames = std::stoi(value);
+            else if (arg == "--instances")
+                options.instances = std::stoi(value);
+            else if (arg == "--occlusion" && (value == "on" || value == "off"))
+                options.occlusionCulling = value == "on";
+            else if (arg == "--prepass" && (value == "on" || value == "off"))
+                options.depthPrePass = value == "on";
+            else if (arg == "--shading" && (value == "forward" || value == "deferred" || value == "visibility"))
+                options.shading = value == "forward" ? Engine::ShadingMode::FORWARD
+                    : value == "deferred" ? Engine::ShadingMode::DEFERRED : Engine::ShadingMode::VISIBILITY;
+            else if (arg == "--depth" && (value == "double" || value == "float"))
+                options.depthFormat = value == "double" ? Engine::DepthFormat::FLOAT64 : Engine::DepthFormat::FLOAT32_REVERSED;
+            else if (arg == "--msaa" && (value == "on" || value == "off"))
+                options.multisampling = value == "on";
+            else if (arg == "--output")
+                options.output = value;
+            else if (arg == "--json")
+                options.json = value;
+            else if (arg == "--format" && (value == "png" || value == "ppm"))
+                options.format = value == "png" ? Headless::ImageFormat::PNG : Headless::ImageFormat::PPM;
+            else
+                throw std::runtime_error("unknown option " + std::string(arg) + " " + value);
+        }
+
+        if (options.model.empty())
+            throw std::runtime_error("no model file given");
+
+        if (options.width <= 0 || options.height <= 0 || options.frames <= 0 || options.instances <= 0)
+            throw std::runtime_error("width, height, frames and instances must be positive");
+
+        if (options.check && options.benchmark)
+            throw std::runtime_error("--check renders every frame twice and can't be benchmarked");
+
+        return options;
+    }
+
+    // Maps that are not given are replaced with a single texel: white color, flat normal, no specular
+    Engine::Texture loadTexture(const std::string& filename, Engine::ColorChannel r, Engine::ColorChannel g, Engine::ColorChannel b)
+    {
+        if (filename.empty())
+            return { { r, g, b, Engine::Color::MAX }, 1, 1 };
+
+        return Engine::TextureParser(filename).parse();
+    }
+
+    int getMaxChannelDifference(const Engine::FrameBuffer& frame, const Engine::FrameBuffer& reference)
+    {
+        const auto pixels = frame.readRGB();
+        const auto referencePixels = reference.readRGB();
+        int maxDifference = 0;
+
+        for (std::size_t i = 0; i < pixels.size(); i++)
+            maxDifference = (std::max)(maxDifference, std::abs(static_cast<int>(pixels[i]) - static_cast<int>(referencePixels[i])));
+
+        return maxDifference;
+    }
+
+    std::string frameFilename(const Options& options, int frame, const Headless::ImageWriter& writer)
+    {
+        std::stringstream ss;
+        ss << options.output << '_' << std::setw(4) << std::setfill('0') << frame << writer.getExtension();
+
+        return ss.str();
+    }
+
+    // Full circle around the Y axis over all frames
+    void placeCamera(Engine::Scene::Camera& camera, int frame, int frames)
+    {
+        const double angle = 2 * PI * frame / frames;
+        camera.changePosition(Vector3<double>({ CAMERA_DISTANCE * std::sin(angle), 0.0, CAMERA_DISTANCE * std::cos(angle) }));
+    }
+
+    // More than one instance are laid out on a square grid in the XY plane that takes the space of one model
+    void addModel(Engine::Scene::Scene& scene, const std::shared_ptr<Engine::Scene::Object>& model, int instances)
+    {
+        if (instances == 1)
+        {
+            scene.addObject(model);
+            return;
+        }
+
+        const int side = static_cast<int>(std::ceil(std::sqrt(instances)));
+        const double scale = 1.0 / side;
+
+        for (int i = 0; i < instances; i++)
+        {
+            const double x = (2 * (i % side) + 1) * scale - 1;
+            const double y = (2 * (i / side) + 1) * scale - 1;
+
+            const Matrix4<double> matrix = Engine::createTranslateMatrix(Vector4<double>({ x, y, 0.0, 1.0 }))
+                * Engine::createScaleMatrix(Vector4<double>({ scale, scale, scale, 1.0 }));
+
+            scene.addInstance(std::make_shared<Engine::Scene::Instance>(model, matrix));
+        }
+    }
+
+    void runBenchmark(const Options& options, Engine::Scene::Scene& scene, Engine::Scene::Camera& camera,
+        Engine::Viewport& viewport, Engine::Renderer& renderer)
+    {
+        Headless::Benchmark benchmark({
+            options.model,
+            options.width,
+            options.height,
+            Engine::isAvx2Supported() ? "avx2" : "scalar",
+            std::thread::hardware_concurrency(),
+            options.instances,
+            options.occlusionCulling,
+            options.depthPrePass,
+            options.shading == Engine::ShadingMode::DEFERRED ? "deferred"
+                : options.shading == Engine::ShadingMode::VISIBILITY ? "visibility" : "forward",
+            options.depthFormat == Engine::DepthFormat::FLOAT64 ? "double" : "float",
+            options.multisampling
+        });
+
+        renderer.setProfiling(true);
+
+        // Warm up caches and wake the workers
+        placeCamera(camera, 0, options.frames);
+        renderer.render(scene, viewport);
+
+        for (int frame = 0; frame < options.frames; frame++)
+        {
+            placeCamera(camera, frame, options.frames);
+            renderer.render(scene, viewport);
+
+            Engine::FrameStats stats = renderer.getFrameStats();
+
+            // There is no window, present is the read back of the frame buffer. The pixels are not used,
+            // the copy is kept on purpose as the measured work.
+            const auto presentStart = std::chrono::steady_clock::now();
+            [[maybe_unused]] const auto pixels = renderer.getFrameBuffer().readRGB();
+            stats.present = std::chrono::steady_clock::now() - presentStart;
+
+            benchmark.addFrame(stats);
+        }
+
+        if (options.json.empty())
+        {
+            benchmark.writeJson(std::cout);
+            return;
+        }
+
+        std::ofstream out(options.json);
+        benchmark.writeJson(out);
+
+        if (!out)
+            throw std::runtime_error("could not write " + options.json);
+    }
+
+    void setUpRenderer(Engine::Renderer& renderer, const Options& options, Engine::ShadingMode shading)
+    {
+        renderer.setOcclusionCulling(options.occlusionCulling);
+        renderer.setDepthPrePass(options.depthPrePass);
+        renderer.setShadingMode(shading);
+        renderer.setDepthFormat(options.depthFormat);
+        renderer.setMultisampling(options.multisampling);
+    }
+
+    void run(const Options& options)
+    {
+        Engine::Renderer renderer(options.width, options.height);
+        setUpRenderer(renderer, options, options.shading);
+
+        auto model = std::make_shared<Engine::Scene::Object>(Engine::loadMesh(options.model, &renderer.getThreadPool()));
+
+        model->setDiffuseMap(Engine::DiffuseMap::fromTexture(loadTexture(options.diffuseMap, 0xFF, 0xFF, 0xFF)));
+        model->setNormalMap(Engine::NormalMap::fromTexture(loadTexture(options.normalMap, 0x80, 0x80, 0xFF)));
+        model->setSpecularMap(Engine::SpecularMap::fromTexture(loadTexture(options.specularMap, 0, 0, 0)));
+
+        auto camera = std::make_shared<Engine::Scene::Camera>(Vector3<double>({ 0.0, 0.0, CAMERA_DISTANCE }),
+            Vector3<double>({ 0.0, 0.0, 0.0 }), Vector3<double>({ 0.0, 1.0, 0.0 }), PI / 2,
+            static_cast<double>(options.width) / options.height, 0, 10.0);
+
+        Engine::Scene::Scene scene;
+        scene.addCamera(camera);
+        addModel(scene, model, options.instances);
+
+        Engine::Viewport viewport(0, 0, options.width, options.height);
+
+        if (options.benchmark)
+        {
+            runBenchmark(options, scene, *camera, viewport, renderer);
+            return;
+        }
+
+        const Headless::ImageWriter writer(options.format);
+
+        std::unique_ptr<Engine::Renderer> reference;
+        if (options.check)
+        {
+            reference = std::make_unique<Engine::Renderer>(options.width, options.height);
+            setUpRenderer(*reference, options, Engine::ShadingMode::FORWARD);
+
+            // Only forward shading multisamples
+            reference->setMultisampling(options.multisampling && options.shading == Engine::ShadingMode::FORWARD);
+        }
+
+        for (int frame = 0; frame < options.frames; frame++)
+        {
+            placeCamera(*camera, frame, options.frames);
+            renderer.render(scene, viewport);
+            writer.write(renderer.getFrameBuffer(), frameFilename(options, frame, writer));
+
+            if (!reference)
+                continue;
+
+            reference->render(scene, viewport);
+            const int difference = getMaxChannelDifference(renderer.getFrameBuffer(), reference->getFrameBuffer());
+
+            std::cout << "frame " << frame << ": max difference from forward shading " << difference << std::endl;
+
+            if (difference > CHECK_TOLERANCE)
+                throw std::runtime_error("frame " + std::to_string(frame) + " differs from forward shading");
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        run(parseOptions(argc, argv));
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+}
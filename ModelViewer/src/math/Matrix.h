@@ -172,7 +172,7 @@ namespace ModelViewer
             // Find determinant of A[][] 
             T det = determinant(A, Size);
             if (det == 0)
-                throw std::exception("could not find inverse matrix: determinant is zero");
+                throw std::runtime_error("could not find inverse matrix: determinant is zero");
             
             // Find adjoint 
             T adj[Size][Size];
@@ -82,7 +82,7 @@ namespace ModelViewer
         template<typename E>
         Vector<typename stdext::promote<T, E>::type, Size> componentwiseMultiplication(const Vector<E, Size>& rhs) const
         {
-            Vector<stdext::promote<T, E>::type, Size> out;
+            Vector<typename stdext::promote<T, E>::type, Size> out;
 
             for (std::size_t i = 0; i < Size; i++)
                 out[i] = m_data[i] * rhs[i];
@@ -100,10 +100,8 @@ namespace ModelViewer
             return m_data[index];
         }
 
-        Vector operator*(const Vector& vec) const
-        {
-            static_assert(false);
-        }
+        // Ambiguous: use dotProduct, crossProduct or componentwiseMultiplication
+        Vector operator*(const Vector& vec) const = delete;
 
         Vector operator*(T number) const
         {
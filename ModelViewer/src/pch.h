@@ -15,11 +15,25 @@
 #include <optional>
 #include <unordered_set>
 #include <future>
+#include <atomic>
+#include <thread>
 #include <algorithm>
 #include <numeric>
-#include <execution>
 #include <variant>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <bitset>
+#include <charconv>
+#include <filesystem>
 
 // Windows Header Files
+#ifdef _WIN32
 #include <windows.h>
-#include <gdiplus.h>
\ No newline at end of file
+#include <gdiplus.h>
+#endif
\ No newline at end of file